@@ -0,0 +1,58 @@
+#!/bin/bash
+# 在本机loopback上对比test_bench_server的各个实现，输出README中的markdown表格
+#
+# usage: ./bench.sh
+# 可以通过环境变量调整：
+#   THREADS="2 4 8" SESSIONS="10 100 1000" SIZE=4096 DURATION=5 MODES="pooled stack coalesce"
+#
+# 服务器和客户端使用相同的线程数，结果为吞吐量（MiB/s）以及p99往返延迟（us）
+
+set -e
+cd "$(dirname "$0")"
+
+THREADS=${THREADS:-"2 4 8"}
+SESSIONS=${SESSIONS:-"10 100 1000"}
+SIZE=${SIZE:-4096}
+DURATION=${DURATION:-5}
+MODES=${MODES:-"pooled stack coalesce"}
+PORT=${PORT:-2533}
+CXX=${CXX:-g++}
+OUT=${OUT:-/tmp/co_bench}
+
+mkdir -p "$OUT"
+for target in test_bench_server test_bench_client; do
+    $CXX -std=c++17 -O2 -pthread -I. $target.cpp -o "$OUT/$target"
+done
+
+server=
+trap '[ -n "$server" ] && kill $server 2>/dev/null' EXIT
+
+echo "size: $SIZE bytes, duration: ${DURATION}s, cpus: $(nproc)"
+echo
+header="| (threads / sessions) \\\\ server |"
+line="| ------------------------------ |"
+for mode in $MODES; do
+    header="$header co $mode |"
+    line="$line ---------- |"
+done
+echo "$header"
+echo "$line"
+
+for threads in $THREADS; do
+    for sessions in $SESSIONS; do
+        row=$(printf "| %-30s |" "$threads / $sessions")
+        for mode in $MODES; do
+            "$OUT/test_bench_server" "$threads" "$PORT" "$mode" &
+            server=$!
+            sleep 0.5
+            result=$("$OUT/test_bench_client" "$PORT" "$threads" "$sessions" "$SIZE" "$DURATION")
+            kill $server
+            wait $server 2>/dev/null || true
+            server=
+            throughput=$(echo "$result" | awk '/^throughput/ { print $2 }')
+            p99=$(echo "$result" | awk -F'[ ,]+' '/^latency/ { print $5 }')
+            row="$row $throughput ($p99) |"
+        done
+        echo "$row"
+    done
+done
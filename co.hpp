@@ -1,7 +1,23 @@
+#include "co/Buffer.h"
 #include "co/Context.h"
 #include "co/Coroutine.h"
+#include "co/CpuTime.h"
+#include "co/EntryPoint.h"
+#include "co/Generator.h"
+#include "co/Histogram.h"
+#include "co/Local.h"
+#include "co/Policy.h"
+#include "co/StackArena.h"
+#include "co/StackUsage.h"
 #include "co/State.h"
+#include "co/Statistics.h"
+#include "co/Trace.h"
 #include "co/Utilities.h"
 
 // experimental
 #include "co/posix.h"
+#include "co/ConnectionPool.h"
+#include "co/TaskGroup.h"
+#include "co/Select.h"
+#include "co/LoopGroup.h"
+#include "co/Task.h"
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace co {
+
+class BufferPool;
+
+// 从BufferPool借出的缓冲区，析构时自动归还
+// Note: 只允许在借出的线程归还
+class Buffer {
+    friend class BufferPool;
+
+public:
+    Buffer() = default;
+    ~Buffer() { release(); }
+
+    Buffer(Buffer &&rhs) noexcept
+        : _pool(std::exchange(rhs._pool, nullptr)),
+          _data(std::exchange(rhs._data, nullptr)),
+          _size(std::exchange(rhs._size, 0)) {}
+
+    Buffer& operator=(Buffer &&rhs) noexcept {
+        if(this != &rhs) {
+            release();
+            _pool = std::exchange(rhs._pool, nullptr);
+            _data = std::exchange(rhs._data, nullptr);
+            _size = std::exchange(rhs._size, 0);
+        }
+        return *this;
+    }
+
+    Buffer(const Buffer&) = delete;
+    Buffer& operator=(const Buffer&) = delete;
+
+    char* data() const { return _data; }
+
+    // 有效数据长度
+    size_t size() const { return _size; }
+    void resize(size_t size) { _size = size; }
+
+    size_t capacity() const;
+
+    explicit operator bool() const { return _data; }
+
+    // 提前归还
+    void release();
+
+private:
+    Buffer(BufferPool *pool, char *data): _pool(pool), _data(data) {}
+
+private:
+    BufferPool *_pool {};
+    char *_data {};
+    size_t _size {};
+};
+
+// 定长缓冲区池，按slab批量分配，空闲缓冲区以LIFO复用
+//
+// 占用的内存只和同时借出的缓冲区数目（的峰值）相关
+// 而不是连接数目，适合大量空闲连接的场合
+class BufferPool {
+    friend class Buffer;
+
+public:
+    constexpr static size_t DEFAULT_BUFFER_SIZE = 1 << 16;
+    constexpr static size_t DEFAULT_SLAB_BUFFERS = 16;
+
+    explicit BufferPool(size_t bufferSize = DEFAULT_BUFFER_SIZE,
+                        size_t slabBuffers = DEFAULT_SLAB_BUFFERS)
+        : _bufferSize(bufferSize),
+          _slabBuffers(slabBuffers) {}
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    Buffer acquire();
+
+    size_t bufferSize() const { return _bufferSize; }
+
+    // 已分配的缓冲区总数
+    size_t capacity() const { return _slabs.size() * _slabBuffers; }
+
+    // 正在借出的缓冲区数目
+    size_t inUse() const { return capacity() - _free.size(); }
+
+private:
+    void release(char *data) { _free.emplace_back(data); }
+
+    void grow();
+
+private:
+    size_t _bufferSize;
+    size_t _slabBuffers;
+    std::vector<std::unique_ptr<char[]>> _slabs;
+    std::vector<char*> _free;
+};
+
+inline size_t Buffer::capacity() const {
+    return _pool ? _pool->bufferSize() : 0;
+}
+
+inline void Buffer::release() {
+    if(_data) {
+        _pool->release(_data);
+        _data = nullptr;
+        _size = 0;
+    }
+}
+
+inline Buffer BufferPool::acquire() {
+    if(_free.empty()) {
+        grow();
+    }
+    auto data = _free.back();
+    _free.pop_back();
+    return Buffer{this, data};
+}
+
+inline void BufferPool::grow() {
+    // 不需要value-initialize
+    std::unique_ptr<char[]> slab {new char[_bufferSize * _slabBuffers]};
+    // 逆序压栈，使得先借出低地址
+    for(size_t i = _slabBuffers; i--;) {
+        _free.emplace_back(slab.get() + i * _bufferSize);
+    }
+    _slabs.emplace_back(std::move(slab));
+}
+
+} // co
@@ -0,0 +1,281 @@
+#pragma once
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "Coroutine.h"
+#include "posix.h"
+
+namespace co {
+
+class ConnectionPool;
+
+// 从ConnectionPool借出的连接，析构时自动归还
+// 连接出错（或者状态不可复用）时应调用close()，而不是直接::close(fd())
+class PooledConnection {
+    friend class ConnectionPool;
+
+public:
+    PooledConnection() = default;
+    ~PooledConnection() { release(false); }
+
+    PooledConnection(PooledConnection &&rhs) noexcept
+        : _pool(std::exchange(rhs._pool, nullptr)),
+          _target(std::exchange(rhs._target, nullptr)),
+          _fd(std::exchange(rhs._fd, -1)) {}
+
+    PooledConnection& operator=(PooledConnection &&rhs) noexcept {
+        if(this != &rhs) {
+            release(false);
+            _pool = std::exchange(rhs._pool, nullptr);
+            _target = std::exchange(rhs._target, nullptr);
+            _fd = std::exchange(rhs._fd, -1);
+        }
+        return *this;
+    }
+
+    PooledConnection(const PooledConnection&) = delete;
+    PooledConnection& operator=(const PooledConnection&) = delete;
+
+    int fd() const { return _fd; }
+
+    explicit operator bool() const { return _fd >= 0; }
+
+    // 关闭连接而不归还，释放的名额可以用于重新连接
+    void close() { release(true); }
+
+private:
+    struct Target;
+
+    PooledConnection(ConnectionPool *pool, Target *target, int fd)
+        : _pool(pool), _target(target), _fd(fd) {}
+
+    void release(bool broken);
+
+private:
+    ConnectionPool *_pool {};
+    Target *_target {};
+    int _fd {-1};
+};
+
+struct PooledConnection::Target {
+    struct Idle {
+        int fd;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    // 按归还时间排序，最新的在末尾
+    std::vector<Idle> idle;
+    // 借出、空闲和正在连接的总数
+    size_t total {};
+    std::deque<std::shared_ptr<Coroutine>> waiters;
+};
+
+// 按地址复用的TCP连接池，每个线程一个，见getConnectionPool()
+//
+// - checkout()优先取最近归还的空闲连接，取出前用co::poll检查对端是否已经关闭
+// - 没有空闲连接时用co::connect新建（沿用PollConfig::connectRetries的back-off）
+// - 单个地址的连接数（包括借出、空闲和正在连接的）达到上限时，当前协程排队等待
+// - 空闲超过idleTimeout的连接由后台协程定期关闭
+//
+// Note: 等待者由loop()的就绪队列唤醒，借出的连接不能比连接池活得更久
+class ConnectionPool {
+    friend class PooledConnection;
+
+public:
+    using Milliseconds = std::chrono::milliseconds;
+
+    constexpr static auto DEFAULT_MAX_CONNECTIONS = size_t(64);
+    constexpr static auto DEFAULT_MAX_IDLE = size_t(16);
+    constexpr static auto DEFAULT_IDLE_TIMEOUT = std::chrono::milliseconds(30000);
+
+    // 每个地址的限制
+    size_t       maxConnections {DEFAULT_MAX_CONNECTIONS};
+    size_t       maxIdle {DEFAULT_MAX_IDLE};
+    Milliseconds idleTimeout {DEFAULT_IDLE_TIMEOUT};
+
+    ConnectionPool() = default;
+    ~ConnectionPool();
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // 借出一个到addr的连接，必要时阻塞当前协程
+    // 连接失败时返回空的PooledConnection，errno同co::connect，等待期间被取消时为ECANCELED
+    PooledConnection checkout(const sockaddr *addr, socklen_t len);
+
+    // 空闲连接数目
+    size_t idle() const { return _idle; }
+
+    // 累计新建的连接数目
+    size_t connects() const { return _connects; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+    using Target = PooledConnection::Target;
+
+    void release(Target &target, int fd, bool broken);
+
+    // 唤醒target的一个等待者
+    void wake(Target &target);
+
+    // 等待名额的协程
+    struct Waiting {
+        Target    *target;
+        Coroutine *coroutine;
+    };
+
+    // 等待者被取消，移出等待队列，Parking的canceller
+    static void onWaiterCancel(void *argument);
+
+    // 后台协程：定期关闭超时的空闲连接，没有空闲连接时退出
+    void reap();
+
+    static bool healthy(int fd);
+
+private:
+    std::unordered_map<std::string, Target> _targets;
+    size_t _idle {};
+    size_t _connects {};
+    bool _reaping {};
+};
+
+inline ConnectionPool& getConnectionPool() {
+    static thread_local ConnectionPool pool;
+    return pool;
+}
+
+inline void PooledConnection::release(bool broken) {
+    if(_fd >= 0) {
+        _pool->release(*_target, _fd, broken);
+        _fd = -1;
+    }
+}
+
+inline ConnectionPool::~ConnectionPool() {
+    for(auto &&target : _targets) {
+        for(auto &&idle : target.second.idle) {
+            ::close(idle.fd);
+        }
+    }
+}
+
+inline PooledConnection ConnectionPool::checkout(const sockaddr *addr, socklen_t len) {
+    auto &target = _targets[std::string(reinterpret_cast<const char*>(addr), len)];
+    for(;;) {
+        while(!target.idle.empty()) {
+            int fd = target.idle.back().fd;
+            target.idle.pop_back();
+            --_idle;
+            if(healthy(fd)) {
+                return {this, &target, fd};
+            }
+            ::close(fd);
+            --target.total;
+        }
+        if(target.total < maxConnections) {
+            // 连接期间同样占用名额
+            ++target.total;
+            ++_connects;
+            int fd = ::socket(addr->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if(fd >= 0 && co::connect(fd, addr, len) == 0) {
+                return {this, &target, fd};
+            }
+            int savedErrno = errno;
+            if(fd >= 0) ::close(fd);
+            --target.total;
+            wake(target);
+            errno = savedErrno;
+            return {};
+        }
+        if(!Coroutine::test()) {
+            errno = EAGAIN;
+            return {};
+        }
+        auto &coroutine = Coroutine::current();
+        if(!coroutine.cancelled()) {
+            target.waiters.emplace_back(coroutine.shared_from_this());
+            Waiting waiting {&target, &coroutine};
+            Parking parking {{onWaiterCancel, &waiting}};
+            this_coroutine::yield();
+        }
+        if(coroutine.cancelled()) {
+            // 可能已经被release唤醒，名额转交给下一个等待者
+            wake(target);
+            errno = ECANCELED;
+            return {};
+        }
+    }
+}
+
+inline void ConnectionPool::release(Target &target, int fd, bool broken) {
+    if(broken || target.idle.size() >= maxIdle) {
+        ::close(fd);
+        --target.total;
+    } else {
+        target.idle.push_back({fd, Clock::now()});
+        ++_idle;
+        if(!_reaping && Coroutine::test()) {
+            _reaping = true;
+            Environment::instance().createCoroutine([this] { reap(); })->resume();
+        }
+    }
+    wake(target);
+}
+
+inline void ConnectionPool::wake(Target &target) {
+    if(target.waiters.empty()) return;
+    getPollConfig().ready.emplace_back(std::move(target.waiters.front()));
+    target.waiters.pop_front();
+}
+
+inline void ConnectionPool::onWaiterCancel(void *argument) {
+    auto &waiting = *static_cast<Waiting*>(argument);
+    auto &waiters = waiting.target->waiters;
+    for(auto iter = waiters.begin(); iter != waiters.end(); ++iter) {
+        if(iter->get() == waiting.coroutine) {
+            getPollConfig().ready.emplace_back(std::move(*iter));
+            waiters.erase(iter);
+            return;
+        }
+    }
+}
+
+inline void ConnectionPool::reap() {
+    using namespace std::chrono;
+    while(_idle > 0) {
+        auto interval = std::max<milliseconds>(idleTimeout / 2, milliseconds(1));
+        // 与connect的back-off相同，以poll作为毫秒级的sleep
+        // 被取消（比如co::stop()）时不再清理，下一次release重新启动
+        if(co::poll(nullptr, 0, interval.count()) < 0) break;
+        auto expired = Clock::now() - idleTimeout;
+        for(auto &&entry : _targets) {
+            auto &target = entry.second;
+            auto &idle = target.idle;
+            size_t n = 0;
+            while(n < idle.size() && idle[n].since <= expired) {
+                ::close(idle[n].fd);
+                ++n;
+            }
+            if(n == 0) continue;
+            idle.erase(idle.begin(), idle.begin() + n);
+            _idle -= n;
+            target.total -= n;
+            for(size_t i = 0; i < n; ++i) wake(target);
+        }
+    }
+    _reaping = false;
+}
+
+inline bool ConnectionPool::healthy(int fd) {
+    // 空闲连接上不应该有任何数据，可读意味着FIN、RST或者协议错误
+    pollfd pfd {fd, POLLIN, 0};
+    return co::poll(&pfd, 1, 0) == 0;
+}
+
+} // co
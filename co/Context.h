@@ -3,6 +3,7 @@
 #include <cstring>
 #include <iterator>
 #include "contextswitch.h"
+#include "Policy.h"
 
 namespace co {
 
@@ -21,24 +22,34 @@ namespace co {
 //     | regs[12]: rbx |
 // hig | regs[13]: rsp |
 
-class Coroutine;
+template <typename PolicyType>
+class BasicCoroutine;
 
 // 协程的上下文，只实现x86_64
-class Context final {
+// 栈大小和分配器来自PolicyType，见Policy.h
+template <typename PolicyType>
+class BasicContext final {
 public:
-    using Callback = void(*)(Coroutine*);
+    using Callback = void(*)(BasicCoroutine<PolicyType>*);
     using Word = void*;
 
-    constexpr static size_t STACK_SIZE = 1 << 17;
+    constexpr static size_t STACK_SIZE = PolicyType::STACK_SIZE;
     constexpr static size_t RDI = 7;
+    constexpr static size_t R12 = 3;
     // constexpr static size_t RSI = 8;
     constexpr static size_t RET = 9;
     constexpr static size_t RSP = 13;
+    // 栈染色使用的字节
+    constexpr static unsigned char PAINT = 0xcd;
 
 public:
+    // 经由配置的分配器分配，默认为StackArena，未启用时等同于堆上分配
+    static void* operator new(size_t size) { return PolicyType::StackAllocator::allocate(size); }
+    static void operator delete(void *pointer) { PolicyType::StackAllocator::deallocate(pointer); }
+
     void prepare(Callback ret, Word rdi);
 
-    void switchFrom(Context *previous);
+    void switchFrom(BasicContext *previous);
 
     // 只在上一个context已经销毁的时候调用
     // 既直接切入到this，不为上一个context做保护现场
@@ -46,6 +57,13 @@ public:
 
     bool test();
 
+    // 用PAINT填充整个栈，需要在prepare之前调用
+    void paint();
+
+    // 栈使用过的最大深度（字节）
+    // 仅在paint()之后有意义
+    size_t highWater() const;
+
 private:
     Word getSp();
 
@@ -60,39 +78,71 @@ private:
 };
 
 
-inline void Context::switchFrom(Context *previous) {
+template <typename PolicyType>
+inline void BasicContext<PolicyType>::switchFrom(BasicContext *previous) {
     contextSwitch(previous, this);
 }
 
-inline void Context::switchOnly() {
+template <typename PolicyType>
+inline void BasicContext<PolicyType>::switchOnly() {
     contextSwitchOnly(this);
 }
 
-inline void Context::prepare(Context::Callback ret, Context::Word rdi) {
+template <typename PolicyType>
+inline void BasicContext<PolicyType>::prepare(Callback ret, Word rdi) {
     Word sp = getSp();
     fillRegisters(sp, ret, rdi);
 }
 
-inline bool Context::test() {
+template <typename PolicyType>
+inline bool BasicContext<PolicyType>::test() {
     char jojo;
     ptrdiff_t diff = std::distance(std::begin(_stack), &jojo);
     return diff >= 0 && diff < STACK_SIZE;
 }
 
-inline Context::Word Context::getSp() {
+template <typename PolicyType>
+inline void BasicContext<PolicyType>::paint() {
+    ::memset(_stack, PAINT, sizeof _stack);
+}
+
+template <typename PolicyType>
+inline size_t BasicContext<PolicyType>::highWater() const {
+    // 栈向低地址增长，从底部找到第一个被改写过的字节
+    using Chunk = unsigned long long;
+    Chunk pattern;
+    ::memset(&pattern, PAINT, sizeof pattern);
+    size_t index = 0;
+    for(; index + sizeof(Chunk) <= STACK_SIZE; index += sizeof(Chunk)) {
+        Chunk chunk;
+        ::memcpy(&chunk, _stack + index, sizeof chunk);
+        if(chunk != pattern) break;
+    }
+    while(index < STACK_SIZE && static_cast<unsigned char>(_stack[index]) == PAINT) {
+        ++index;
+    }
+    return STACK_SIZE - index;
+}
+
+template <typename PolicyType>
+inline typename BasicContext<PolicyType>::Word BasicContext<PolicyType>::getSp() {
     auto sp = std::end(_stack) - sizeof(Word);
     sp = decltype(sp)(reinterpret_cast<size_t>(sp) & (~0xF));
     return sp;
 }
 
-inline void Context::fillRegisters(Word sp, Callback ret, Word rdi, ...) {
+template <typename PolicyType>
+inline void BasicContext<PolicyType>::fillRegisters(Word sp, Callback ret, Word rdi, ...) {
     ::memset(_registers, 0, sizeof _registers);
+    // 首次切入时ret到contextEntry，再由它call真正的入口ret
     auto pRet = (Word*)sp;
-    *pRet = (Word)ret;
+    *pRet = (Word)contextEntry;
     _registers[RSP] = sp;
     _registers[RET] = *pRet;
+    _registers[R12] = (Word)ret;
     _registers[RDI] = rdi;
 }
 
+using Context = BasicContext<DefaultPolicy>;
 
 } // co
@@ -1,23 +1,85 @@
 #pragma once
+#include <csignal>
 #include <cstddef>
 #include <cstring>
 #include <functional>
 #include <memory>
 #include <vector>
 #include <array>
+#include <type_traits>
+#include <utility>
+#include <chrono>
 #include "State.h"
+#include "Statistics.h"
 #include "Context.h"
+#include "CpuTime.h"
+#include "EntryPoint.h"
+#include "Policy.h"
+#include "StackUsage.h"
+#include "Trace.h"
 
 namespace co {
 
-class Environment;
+template <typename PolicyType>
+class BasicEnvironment;
+template <typename PolicyType>
+class BasicCoroutine;
+template <typename PolicyType>
+struct BasicPollConfig;
+
+// 默认配置，见Policy.h
+using Environment = BasicEnvironment<DefaultPolicy>;
+using Coroutine = BasicCoroutine<DefaultPolicy>;
+
+// internal
+// 每个线程、每种配置一份的快速路径，只含指针，因此不需要guard和析构
+// 由Environment / PollConfig在构造时填入，切换时更新current
+template <typename PolicyType>
+struct ThreadBlock {
+    BasicEnvironment<PolicyType> *environment;
+    BasicPollConfig<PolicyType>  *poll;
+    BasicCoroutine<PolicyType>   *main;
+    BasicCoroutine<PolicyType>   *current;
+};
+
+template <typename PolicyType>
+inline ThreadBlock<PolicyType>& threadBlock() {
+    static thread_local ThreadBlock<PolicyType> block;
+    return block;
+}
+
+// internal
+// 协程局部存储的一个值，见co::local
+struct LocalValue {
+    void *value;
+    void (*destroy)(void*);
+};
+
+// 通用的唤醒回调，不依赖于具体的协程类型
+// 比如C++20无栈协程可以用handle.address()作为argument
+struct Waker {
+    using Function = void(*)(void*);
 
-class Coroutine: public std::enable_shared_from_this<Coroutine> {
-    friend class Environment;
-    friend class Context;
+    Function wake {};
+    void *argument {};
+
+    explicit operator bool() const { return wake; }
+    void operator()() const { wake(argument); }
+};
+
+// 有栈协程，PolicyType为所属Environment的编译期配置
+template <typename PolicyType>
+class BasicCoroutine: public std::enable_shared_from_this<BasicCoroutine<PolicyType>> {
+    friend class BasicEnvironment<PolicyType>;
+    template <typename> friend class Generator;
+    template <typename> friend class local;
 
 public:
-    static Coroutine& current();
+    using Policy = PolicyType;
+    using Environment = BasicEnvironment<PolicyType>;
+    using Context = BasicContext<PolicyType>;
+
+    static BasicCoroutine& current();
 
     // 测试当前控制流是否位于协程上下文
     static bool test();
@@ -32,6 +94,17 @@ public:
 
     static void yield();
 
+    // 对称式切换：从当前协程直接切入target，只需一次contextSwitch
+    // target在环境中接替当前协程的位置，之后target让出或退出时
+    // 将返回到当前协程原先的调用者
+    //
+    // 返回false表示没有切换：target为当前协程、已经退出，或者位于当前调用链上
+    // （resume的调用者除外，此时等价于yield）
+    //
+    // Note1: 在非协程上下文（主协程）中调用等价于target.resume()
+    // Note2: 与yield相同，当前协程的生命周期需要由使用者保证
+    static bool transfer(BasicCoroutine &target);
+
     // Note1: 允许处于EXIT状态的协程重入，从而再次resume
     //        如果不使用这种特性，则用exit() / running()判断
     //
@@ -41,13 +114,43 @@ public:
     //        那建议用runtime()获取
     const State resume();
 
+    // 设置协程退出时的唤醒回调，后设置的会覆盖先前的
+    // 回调在退出协程的栈上执行，且早于Context的回收
+    void onExit(Waker waker);
+
+    // 取消：设置取消标记，如果协程正阻塞在co::的接口中，则撤销关注的事件并安排唤醒
+    // 被唤醒的接口以及之后的阻塞接口都返回-1，errno为ECANCELED
+    // 协程需要自行返回，退出后栈立即归还给回收栈
+    // Note: 已退出的协程不受影响；只用yield等待的协程不会被唤醒，由使用者自行检查cancelled()
+    void cancel();
+    bool cancelled() const { return _cancelled; }
+
+    // internal
+    // 阻塞期间由co::的接口设置，cancel()时调用，见posix.h的Parking
+    void onCancel(Waker waker) { _cancelWaker = waker; }
+
+    // internal
+    // Preemptible作用域的嵌套深度，信号处理函数据此判断能否切走该协程，见posix.h
+    volatile sig_atomic_t& preemptible() { return _preemptible; }
+
+    // 协程的入口，用于按入口分组的统计
+    const EntryPoint& entryPoint() const { return _entryPoint; }
+
+    // 栈的high-water mark（字节）
+    // 仅在Environment::paintStacks(true)之后创建的Context上有效，否则返回0
+    size_t stackHighWater() const;
+
+    // 累计的CPU时间，见Environment::accountCpu()
+    const CpuTime& cpuTime() const { return _cpuTime; }
+
     // usage: Coroutine::current().yield()
     // void yield();
 
-    Coroutine(const Coroutine&) = delete;
-    Coroutine(Coroutine&&) = delete;
-    Coroutine& operator=(const Coroutine&) = delete;
-    Coroutine& operator=(Coroutine&&) = delete;
+    BasicCoroutine(const BasicCoroutine&) = delete;
+    BasicCoroutine(BasicCoroutine&&) = delete;
+    BasicCoroutine& operator=(const BasicCoroutine&) = delete;
+    BasicCoroutine& operator=(BasicCoroutine&&) = delete;
+    ~BasicCoroutine() { releaseLocals(); }
 
 // 由于用到std::make_shared，必须公开这个构造函数
 // TODO 设为private
@@ -56,42 +159,113 @@ public:
     // 构造Coroutine执行函数，entry为函数入口，对应传参为arguments...
     // Note: 不可重入
     template <typename Entry, typename ...Args>
-    Coroutine(Environment *master, Entry &&entry, Args &&...arguments)
+    BasicCoroutine(Environment *master, Entry &&entry, Args &&...arguments)
         : _entry([=] { entry(std::move(arguments)...); }),
           _context(nullptr),
-          _master(master) {}
+          _master(master),
+          _entryPoint(EntryPoint::make<typename std::decay<Entry>::type>(entry)) {}
 
 private:
-    static void routineWrapper(Coroutine *coroutine);
+    static void routineWrapper(BasicCoroutine *coroutine);
+
+    // 延迟分配Context，仅在首次切入前调用
+    void prepareContext();
+
+    // 销毁所有协程局部存储的值
+    void releaseLocals();
 
 private:
     State _runtime {};
     std::unique_ptr<Context> _context;
     std::function<void()> _entry;
     Environment *_master;
+    // 协程间传值用的槽位，见Generator
+    void *_slot {};
+    Waker _exitWaker {};
+    Waker _cancelWaker {};
+    bool _cancelled {};
+    volatile sig_atomic_t _preemptible {};
+    EntryPoint _entryPoint;
+    // 当前Context是否经过染色
+    bool _painted {};
+    CpuTime _cpuTime;
+    // 按co::local的slot下标索引
+    std::vector<LocalValue> _locals;
 };
 
-class Environment {
-    friend class Coroutine;
+// 每个线程一份的协程运行环境
+// PolicyType为编译期配置，见Policy.h，不同配置的Environment各自独立
+template <typename PolicyType>
+class BasicEnvironment {
+    friend class BasicCoroutine<PolicyType>;
+    template <typename> friend class Generator;
 public:
-    static Environment& instance();
+    using Policy = PolicyType;
+    using Coroutine = BasicCoroutine<PolicyType>;
+    using Context = BasicContext<PolicyType>;
+    using Statistics = BasicStatistics<PolicyType::STATISTICS>;
+    using StackUsage = BasicStackUsage<PolicyType::STACK_SIZE>;
+
+    static BasicEnvironment& instance();
 
     template <typename Entry, typename ...Args>
     std::shared_ptr<Coroutine> createCoroutine(Entry &&entry, Args &&...arguments);
 
     Coroutine* current();
 
-    Environment(const Environment&) = delete;
-    Environment& operator=(const Environment&) = delete;
+    // 当前线程的调度统计，拷贝即为快照
+    const Statistics& statistics() const { return _statistics; }
+    Statistics& statistics() { return _statistics; }
+
+    // 栈染色：之后切入的协程在prepare前用Context::PAINT填满栈
+    // 退出时扫描得到high-water mark并记录到stackUsage()
+    // Note: 每次切入新协程都要memset整个栈，仅用于调试和调优STACK_SIZE
+    void paintStacks(bool enable) { _paintStacks = Policy::PROFILING && enable; }
+    bool paintStacks() const { return _paintStacks; }
+
+    const StackUsage& stackUsage() const { return _stackUsage; }
+    StackUsage& stackUsage() { return _stackUsage; }
+
+    // 为当前线程启用StackArena：之后新分配的Context从大页region中切出，
+    // 并优先位于当前线程的NUMA节点（建议先绑定CPU）
+    // 已经分配的Context不受影响，复用和回收照常进行
+    // 配置的StackAllocator不是StackArena时无法启用，返回false
+    bool useStackArena(bool enable = true);
+
+    // CPU时间统计：在每次切换时读取TSC，记录到切出协程的cpuTime()
+    // 开启时会先校准TSC（约10ms）
+    void accountCpu(bool enable);
+    bool accountCpu() const { return _accountCpu; }
+
+    // 单个时间片超过threshold时记录到longSlices()，0为不记录
+    // 需要同时开启accountCpu
+    void longSliceThreshold(std::chrono::nanoseconds threshold);
+
+    const LongSlices& longSlices() const { return _longSlices; }
+    LongSlices& longSlices() { return _longSlices; }
+
+    // 事件跟踪，见Trace
+    void tracing(bool enable, size_t capacity = Trace::DEFAULT_CAPACITY);
+
+    const Trace& trace() const { return _trace; }
+    Trace& trace() { return _trace; }
+
+    BasicEnvironment(const BasicEnvironment&) = delete;
+    BasicEnvironment& operator=(const BasicEnvironment&) = delete;
+    ~BasicEnvironment();
 
 private:
     void push(std::shared_ptr<Coroutine> coroutine);
     void pop();
-    Environment();
+    BasicEnvironment();
+
+    // 所有切换的公共入口，from切出，to切入
+    void onSwitch(Coroutine *from, Coroutine *to);
 
 private:
     std::vector<std::shared_ptr<Coroutine>> _cStack;
     std::shared_ptr<Coroutine> _main;
+    ThreadBlock<PolicyType> *_block;
 
 /// Context 延迟分配和快速复用
 private:
@@ -103,90 +277,201 @@ private:
 
 
 private:
-    std::array<std::unique_ptr<Context>, 0xff> _recycleStack;
+    std::array<std::unique_ptr<Context>, Policy::RECYCLE_CAPACITY> _recycleStack;
     size_t _recycleTop {};
+
+private:
+    Statistics _statistics;
+
+private:
+    bool _paintStacks {};
+    StackUsage _stackUsage;
+
+private:
+    bool _accountCpu {};
+    uint64_t _sliceStart {};
+    uint64_t _longSliceCycles {};
+    LongSlices _longSlices;
+
+private:
+    Trace _trace;
 };
 
 
+template <typename PolicyType>
 template <typename Entry, typename ...Args>
-inline std::shared_ptr<Coroutine> Environment::createCoroutine(Entry &&entry, Args &&...arguments) {
+inline std::shared_ptr<BasicCoroutine<PolicyType>>
+BasicEnvironment<PolicyType>::createCoroutine(Entry &&entry, Args &&...arguments) {
+    ++_statistics.created;
     return std::make_shared<Coroutine>(
         this, std::forward<Entry>(entry), std::forward<Args>(arguments)...);
 }
 
-inline Environment& Environment::instance() {
-    static thread_local Environment env;
+template <typename PolicyType>
+inline BasicEnvironment<PolicyType>& BasicEnvironment<PolicyType>::instance() {
+    if(auto environment = threadBlock<PolicyType>().environment) {
+        return *environment;
+    }
+    static thread_local BasicEnvironment env;
     return env;
 }
 
-inline Coroutine* Environment::current() {
+template <typename PolicyType>
+inline BasicCoroutine<PolicyType>* BasicEnvironment<PolicyType>::current() {
     return _cStack.back().get();
 }
 
-inline void Environment::push(std::shared_ptr<Coroutine> coroutine) {
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::push(std::shared_ptr<Coroutine> coroutine) {
     _cStack.emplace_back(std::move(coroutine));
 }
 
-inline void Environment::pop() {
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::pop() {
     _cStack.pop_back();
 }
 
-inline Environment::Environment() {
+template <typename PolicyType>
+inline BasicEnvironment<PolicyType>::BasicEnvironment() {
     _main = std::make_shared<Coroutine>(this, [](){});
     _main->_context = std::make_unique<Context>();
     // TODO set State
     push(_main);
+    StatisticsRegistry::instance().attach(&_statistics);
+    _block = &threadBlock<PolicyType>();
+    _block->environment = this;
+    _block->main = _main.get();
+    _block->current = _main.get();
+}
+
+template <typename PolicyType>
+inline BasicEnvironment<PolicyType>::~BasicEnvironment() {
+    StatisticsRegistry::instance().detach(&_statistics);
+    _block->environment = nullptr;
+    _block->main = nullptr;
+    _block->current = nullptr;
+}
+
+template <typename PolicyType>
+inline bool BasicEnvironment<PolicyType>::useStackArena(bool enable) {
+    if(!std::is_same<typename Policy::StackAllocator, StackArena>::value) {
+        return !enable;
+    }
+    if(!enable) {
+        StackArena::disable();
+        return true;
+    }
+    return StackArena::enable(sizeof(Context)) != nullptr;
+}
+
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::accountCpu(bool enable) {
+    if(!Policy::PROFILING) return;
+    if(enable) {
+        Tsc::cyclesPerNanosecond();
+        _sliceStart = Tsc::now();
+    }
+    _accountCpu = enable;
+}
+
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::longSliceThreshold(std::chrono::nanoseconds threshold) {
+    _longSliceCycles = threshold.count() > 0 ? Tsc::fromNanoseconds(threshold.count()) : 0;
+}
+
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::tracing(bool enable, size_t capacity) {
+    if(!Policy::TRACING) return;
+    if(enable) {
+        _trace.enable(_main.get(), capacity);
+    } else {
+        _trace.disable();
+    }
 }
 
-inline std::unique_ptr<Context> Environment::reuse() {
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::onSwitch(Coroutine *from, Coroutine *to) {
+    _block->current = to;
+    ++_statistics.switches;
+    if(Policy::TRACING) _trace.record(Trace::SWITCH, from, to);
+    if(!Policy::PROFILING || !_accountCpu) return;
+    auto now = Tsc::now();
+    if(from != _main.get()) {
+        auto slice = now - _sliceStart;
+        from->_cpuTime.add(slice);
+        if(_longSliceCycles && slice >= _longSliceCycles) {
+            _longSlices.push({from->_entryPoint, slice, now});
+        }
+    }
+    _sliceStart = now;
+}
+
+template <typename PolicyType>
+inline std::unique_ptr<BasicContext<PolicyType>> BasicEnvironment<PolicyType>::reuse() {
+    ++_statistics.recycleHits;
     auto up = std::move(_recycleStack[--_recycleTop]);
     return up;
 }
 
-inline void Environment::recycle(std::unique_ptr<Context> trash) {
+template <typename PolicyType>
+inline void BasicEnvironment<PolicyType>::recycle(std::unique_ptr<Context> trash) {
+    ++_statistics.recycled;
     _recycleStack[_recycleTop++] = std::move(trash);
 }
 
-inline Coroutine& Coroutine::current() {
+template <typename PolicyType>
+inline BasicCoroutine<PolicyType>& BasicCoroutine<PolicyType>::current() {
+    if(auto current = threadBlock<PolicyType>().current) {
+        return *current;
+    }
     return *Environment::instance().current();
 }
 
-inline bool Coroutine::test() {
-    return current()._context && current()._context->test();
+template <typename PolicyType>
+inline bool BasicCoroutine<PolicyType>::test() {
+    auto &block = threadBlock<PolicyType>();
+    return block.current && block.current != block.main;
 }
 
-inline const State Coroutine::runtime() const {
+template <typename PolicyType>
+inline const State BasicCoroutine<PolicyType>::runtime() const {
     return _runtime;
 }
 
-inline bool Coroutine::exit() const {
+template <typename PolicyType>
+inline bool BasicCoroutine<PolicyType>::exit() const {
     return _runtime & State::EXIT;
 }
 
-inline bool Coroutine::running() const {
+template <typename PolicyType>
+inline bool BasicCoroutine<PolicyType>::running() const {
     return _runtime & State::RUNNING;
 }
 
-inline const State Coroutine::resume() {
+template <typename PolicyType>
+inline const State BasicCoroutine<PolicyType>::resume() {
     if(_runtime & State::EXIT) {
         return _runtime;
     }
     if(!(_runtime & State::RUNNING)) {
-        _context = _master->reusable() ?
-            _master->reuse() : std::make_unique<Context>();
-        _context->prepare(Coroutine::routineWrapper, this);
-        _runtime |= State::RUNNING;
+        prepareContext();
     }
     auto previous = _master->current();
-    _master->push(shared_from_this());
+    _master->push(this->shared_from_this());
+    _master->onSwitch(previous, this);
     _context->switchFrom(previous->_context.get());
     return _runtime;
 }
 
-inline void Coroutine::yield() {
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::yield() {
     auto &coroutine = current();
     auto &currentContext = coroutine._context;
 
+    // 先于pop，此时coroutine一定存活
+    auto &cStack = coroutine._master->_cStack;
+    coroutine._master->onSwitch(&coroutine,
+        cStack.size() > 1 ? cStack[cStack.size() - 2].get() : nullptr);
     coroutine._master->pop();
 
     auto &previousContext = current()._context;
@@ -198,16 +483,108 @@ inline void Coroutine::yield() {
     }
 }
 
-inline void Coroutine::routineWrapper(Coroutine *coroutine) {
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::onExit(Waker waker) {
+    _exitWaker = waker;
+}
+
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::cancel() {
+    if(_cancelled || exit()) return;
+    _cancelled = true;
+    if(auto waker = std::exchange(_cancelWaker, {})) {
+        waker();
+    }
+}
+
+template <typename PolicyType>
+inline size_t BasicCoroutine<PolicyType>::stackHighWater() const {
+    return _context && _painted ? _context->highWater() : 0;
+}
+
+template <typename PolicyType>
+inline bool BasicCoroutine<PolicyType>::transfer(BasicCoroutine &target) {
+    auto &coroutine = current();
+    auto *master = coroutine._master;
+    auto &cStack = master->_cStack;
+
+    if(&target == &coroutine || (target._runtime & State::EXIT)) {
+        return false;
+    }
+    if(&coroutine == master->_main.get()) {
+        target.resume();
+        return true;
+    }
+    // 切回调用者就是普通的yield
+    if(cStack.size() > 1 && cStack[cStack.size() - 2].get() == &target) {
+        yield();
+        return true;
+    }
+    // 调用链上更早的协程，替换栈顶后它会在_cStack中出现两次
+    for(auto &&caller : cStack) {
+        if(caller.get() == &target) return false;
+    }
+    if(!(target._runtime & State::RUNNING)) {
+        target.prepareContext();
+    }
+    // 原地替换栈顶，不需要push / pop
+    master->onSwitch(&coroutine, &target);
+    cStack.back() = target.shared_from_this();
+    target._context->switchFrom(coroutine._context.get());
+    return true;
+}
+
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::prepareContext() {
+    if(_master->reusable()) {
+        _context = _master->reuse();
+    } else {
+        ++_master->_statistics.recycleMisses;
+        _context = std::make_unique<Context>();
+    }
+    _painted = PolicyType::PROFILING && _master->_paintStacks;
+    if(_painted) {
+        _context->paint();
+    }
+    _context->prepare(BasicCoroutine::routineWrapper, this);
+    _runtime |= State::RUNNING;
+    if(PolicyType::TRACING) {
+        _master->_trace.record(Trace::START, this, nullptr, -1, 0, _entryPoint);
+    }
+}
+
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::releaseLocals() {
+    // 析构函数中可能再次访问co::local，先整体取出
+    auto locals = std::move(_locals);
+    for(auto &&local : locals) {
+        if(local.value) local.destroy(local.value);
+    }
+}
+
+template <typename PolicyType>
+inline void BasicCoroutine<PolicyType>::routineWrapper(BasicCoroutine *coroutine) {
     auto &routine = coroutine->_entry;
     auto &runtime = coroutine->_runtime;
     auto *master = coroutine->_master;
     if(routine) routine();
+    coroutine->releaseLocals();
     runtime ^= (State::EXIT | State::RUNNING);
     // coroutine->yield();
 
+    if(auto waker = std::exchange(coroutine->_exitWaker, {})) {
+        waker();
+    }
+
+    ++master->_statistics.exited;
+    if(PolicyType::TRACING) master->_trace.record(Trace::EXIT, coroutine);
+    if(coroutine->_painted) {
+        master->_stackUsage.record(coroutine->_entryPoint, coroutine->stackHighWater());
+    }
     if(master->recyclable()) {
         master->recycle(std::move(coroutine->_context));
+    } else {
+        ++master->_statistics.discarded;
     }
 
     yield();
@@ -0,0 +1,107 @@
+#pragma once
+#include <x86intrin.h>
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include "EntryPoint.h"
+
+namespace co {
+
+// 基于rdtsc的时间计量，只实现x86_64
+// 假定TSC恒定速率（constant_tsc），且各个核心之间同步
+struct Tsc {
+    static uint64_t now() { return __rdtsc(); }
+
+    // 首次调用时以steady_clock校准，约10ms
+    static double cyclesPerNanosecond();
+
+    static uint64_t toNanoseconds(uint64_t cycles) {
+        return static_cast<uint64_t>(cycles / cyclesPerNanosecond());
+    }
+
+    static uint64_t fromNanoseconds(uint64_t nanoseconds) {
+        return static_cast<uint64_t>(nanoseconds * cyclesPerNanosecond());
+    }
+};
+
+inline double Tsc::cyclesPerNanosecond() {
+    static const double ratio = [] {
+        using Clock = std::chrono::steady_clock;
+        auto start = Clock::now();
+        auto cycles = now();
+        auto elapsed = std::chrono::nanoseconds::zero();
+        while(elapsed < std::chrono::milliseconds(10)) {
+            elapsed = Clock::now() - start;
+        }
+        return double(now() - cycles) / elapsed.count();
+    }();
+    return ratio;
+}
+
+// 每个协程的CPU时间，单位为TSC周期
+// 从切入到切出为一个时间片，主协程不计入
+struct CpuTime {
+    uint64_t cycles {};
+    uint64_t slices {};
+    uint64_t lastSlice {};
+    uint64_t maxSlice {};
+
+    void add(uint64_t slice) {
+        cycles += slice;
+        ++slices;
+        lastSlice = slice;
+        if(slice > maxSlice) maxSlice = slice;
+    }
+};
+
+// 超过阈值的时间片，即两次让出之间计算过久的协程
+struct LongSlice {
+    EntryPoint entry;
+    uint64_t cycles;
+    // 时间片结束时的TSC
+    uint64_t end;
+};
+
+// 最近CAPACITY个LongSlice的环形缓冲区，满了以后覆盖最旧的记录
+class LongSlices {
+public:
+    constexpr static size_t CAPACITY = 64;
+
+    void push(const LongSlice &slice) {
+        _slices[_total++ % CAPACITY] = slice;
+    }
+
+    // 当前保留的记录数目
+    size_t size() const { return _total < CAPACITY ? _total : CAPACITY; }
+
+    // 包括已经被覆盖的记录
+    uint64_t total() const { return _total; }
+
+    // 按时间先后，[0]为最旧的记录
+    const LongSlice& operator[](size_t index) const {
+        return _slices[(_total - size() + index) % CAPACITY];
+    }
+
+    void clear() { _total = 0; }
+
+    // 每条记录一行：时间片长度（微秒）以及入口
+    void dump(std::ostream &os) const;
+
+private:
+    std::array<LongSlice, CAPACITY> _slices {};
+    uint64_t _total {};
+};
+
+inline void LongSlices::dump(std::ostream &os) const {
+    os << "long slices: " << _total << '\n';
+    for(size_t i = 0; i < size(); ++i) {
+        auto &slice = (*this)[i];
+        os << std::setw(10) << Tsc::toNanoseconds(slice.cycles) / 1000 << "us | "
+           << slice.entry.name() << '\n';
+    }
+}
+
+} // co
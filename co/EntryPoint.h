@@ -0,0 +1,75 @@
+#pragma once
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+
+namespace co {
+
+// 协程入口的标识，用于按入口函数分组的统计
+//
+// 普通函数记录其地址，lambda和仿函数记录其类型
+// 两者都不需要额外的内存分配
+struct EntryPoint {
+    const void *address {};
+    const std::type_info *type {};
+
+    template <typename Entry>
+    static EntryPoint make(const Entry &entry);
+
+    // 可读的名字，函数需要-rdynamic才能得到符号名
+    std::string name() const;
+
+    bool operator<(const EntryPoint &rhs) const {
+        if(address != rhs.address) return address < rhs.address;
+        if(type == rhs.type) return false;
+        if(!type || !rhs.type) return !type;
+        return type->before(*rhs.type);
+    }
+};
+
+// internal
+template <typename Entry>
+inline EntryPoint makeEntryPoint(const Entry &entry, std::true_type /* function */) {
+    return {reinterpret_cast<const void*>(entry), &typeid(Entry)};
+}
+
+// internal
+template <typename Entry>
+inline EntryPoint makeEntryPoint(const Entry&, std::false_type /* callable */) {
+    return {nullptr, &typeid(Entry)};
+}
+
+template <typename Entry>
+inline EntryPoint EntryPoint::make(const Entry &entry) {
+    using IsFunction = std::integral_constant<bool,
+        std::is_pointer<Entry>::value
+            && std::is_function<typename std::remove_pointer<Entry>::type>::value>;
+    return makeEntryPoint(entry, IsFunction{});
+}
+
+inline std::string EntryPoint::name() const {
+    if(address) {
+        // 不依赖libdl，glibc的backtrace_symbols即可
+        auto address = const_cast<void*>(this->address);
+        std::unique_ptr<char*, decltype(&::free)> symbols {
+            ::backtrace_symbols(&address, 1), &::free};
+        if(symbols) return symbols.get()[0];
+        char buf[32];
+        ::snprintf(buf, sizeof buf, "%p", address);
+        return buf;
+    }
+    if(type) {
+        int status;
+        std::unique_ptr<char, decltype(&::free)> demangled {
+            abi::__cxa_demangle(type->name(), nullptr, nullptr, &status), &::free};
+        return status == 0 ? demangled.get() : type->name();
+    }
+    return "(unknown)";
+}
+
+} // co
@@ -0,0 +1,189 @@
+#pragma once
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include "Coroutine.h"
+
+namespace co {
+
+// 放弃迭代时由Generator<T>::yield抛出，不需要也不应该被生成器捕获
+struct GeneratorExit {};
+
+// internal
+template <typename Entry>
+struct GeneratorEntry {
+    Entry entry;
+
+    template <typename ...Args>
+    void operator()(Args &&...arguments) const {
+        try {
+            entry(std::forward<Args>(arguments)...);
+        } catch(const GeneratorExit&) {}
+    }
+};
+
+// internal: 放在槽位中，表示迭代者已经放弃
+inline void* generatorExitSlot() {
+    static char slot;
+    return &slot;
+}
+
+// 基于resume / yield的生成器
+//
+// 产出的值只存放在生成器协程的栈上，通过协程内的指针槽位交给迭代者
+// 因此不存在拷贝（迭代者可以直接std::move取走），也没有逐个值的内存分配
+// 生成器协程的Context同样来自Environment的复用栈
+//
+// usage:
+//  co::Generator<int> gen([](int n) {
+//      for(int i = 0; i < n; ++i) co::Generator<int>::yield(i);
+//  }, 10);
+//  for(auto &&v : gen) std::cout << v << std::endl;
+//
+// 提前放弃迭代时，析构会恢复生成器并让yield抛出co::GeneratorExit
+// 生成器栈上的对象因此得以析构，随后协程正常退出并归还Context
+// 移动赋值同样先以这种方式放弃原来的生成器
+//
+// Note: 生成器内部不要调用会挂起的co::接口（比如co::read）
+//       这种挂起不会产出值，迭代者会认为生成器已经结束
+// Note: 生成器内的catch(...)需要重新抛出GeneratorExit
+//       否则栈无法展开，其上的对象连同Context一起泄漏
+template <typename T>
+class Generator {
+public:
+    class Iterator;
+
+    template <typename Entry, typename ...Args>
+    explicit Generator(Entry &&entry, Args &&...arguments);
+    ~Generator();
+
+    Generator(Generator&&) = default;
+    Generator& operator=(Generator &&rhs);
+
+    // 只能在生成器协程内调用
+    // 产出value并让出，直到迭代者推进时才返回
+    static void yield(T &value);
+    static void yield(T &&value);
+
+    Iterator begin();
+    Iterator end();
+
+private:
+    void advance();
+
+    // 停在yield中的生成器展开栈并退出
+    void abandon();
+
+private:
+    std::shared_ptr<Coroutine> _coroutine;
+    T *_current {};
+    bool _started {};
+};
+
+template <typename T>
+class Generator<T>::Iterator {
+public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = T*;
+    using reference = T&;
+
+    explicit Iterator(Generator *generator = nullptr): _generator(generator) {}
+
+    reference operator*() const { return *_generator->_current; }
+    pointer operator->() const { return _generator->_current; }
+
+    Iterator& operator++() {
+        _generator->advance();
+        return *this;
+    }
+    void operator++(int) { ++*this; }
+
+    bool operator==(const Iterator &rhs) const { return current() == rhs.current(); }
+    bool operator!=(const Iterator &rhs) const { return current() != rhs.current(); }
+
+private:
+    pointer current() const { return _generator ? _generator->_current : nullptr; }
+
+private:
+    Generator *_generator;
+};
+
+template <typename T>
+template <typename Entry, typename ...Args>
+inline Generator<T>::Generator(Entry &&entry, Args &&...arguments)
+    : _coroutine(Environment::instance().createCoroutine(
+          GeneratorEntry<typename std::decay<Entry>::type>{std::forward<Entry>(entry)},
+          std::forward<Args>(arguments)...)) {}
+
+template <typename T>
+inline Generator<T>::~Generator() {
+    abandon();
+}
+
+template <typename T>
+inline Generator<T>& Generator<T>::operator=(Generator &&rhs) {
+    if(this == &rhs) return *this;
+    abandon();
+    _coroutine = std::move(rhs._coroutine);
+    _current = std::exchange(rhs._current, nullptr);
+    _started = std::exchange(rhs._started, false);
+    return *this;
+}
+
+template <typename T>
+inline void Generator<T>::yield(T &value) {
+    auto &current = Coroutine::current();
+    current._slot = std::addressof(value);
+    Coroutine::yield();
+    if(current._slot == generatorExitSlot()) throw GeneratorExit{};
+}
+
+template <typename T>
+inline void Generator<T>::yield(T &&value) {
+    // 临时量的生命周期覆盖整个yield调用，让出期间仍然有效
+    auto &current = Coroutine::current();
+    current._slot = std::addressof(value);
+    Coroutine::yield();
+    if(current._slot == generatorExitSlot()) throw GeneratorExit{};
+}
+
+template <typename T>
+inline typename Generator<T>::Iterator Generator<T>::begin() {
+    if(!_started) {
+        _started = true;
+        advance();
+    }
+    return Iterator{this};
+}
+
+template <typename T>
+inline typename Generator<T>::Iterator Generator<T>::end() {
+    return Iterator{};
+}
+
+template <typename T>
+inline void Generator<T>::abandon() {
+    if(!_coroutine) return;
+    // 提前放弃迭代的生成器停在yield中，恢复它并展开栈，退出时Context照常归还
+    // 仅当没有其它地方持有该协程时才这么做
+    auto &coroutine = *_coroutine;
+    if(coroutine.running() && _coroutine.use_count() == 1) {
+        coroutine._slot = generatorExitSlot();
+        coroutine.resume();
+    }
+    _coroutine = nullptr;
+    _current = nullptr;
+}
+
+template <typename T>
+inline void Generator<T>::advance() {
+    _coroutine->_slot = nullptr;
+    _coroutine->resume();
+    _current = static_cast<T*>(_coroutine->_slot);
+}
+
+} // co
@@ -0,0 +1,83 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace co {
+
+// HDR风格的直方图：每个2的幂次区间再线性地分为HALF个桶
+// 相对误差不超过1/HALF，记录只是一次下标计算
+// 不是线程安全的，多线程时各自记录再merge
+//
+// usage:
+//      co::Histogram latencies;
+//      latencies.record(nanoseconds);
+//      auto p99 = latencies.percentile(0.99);
+class Histogram {
+public:
+    constexpr static int SUB_BITS = 8;
+    constexpr static uint64_t HALF = 1 << (SUB_BITS - 1);
+    constexpr static size_t BUCKETS = (64 - SUB_BITS + 1) * HALF + HALF;
+
+    void record(uint64_t value) {
+        ++_counts[index(value)];
+        ++_total;
+        if(value > _max) _max = value;
+    }
+
+    void merge(const Histogram &other);
+
+    // 返回所在桶的上界，p取值[0, 1]
+    uint64_t percentile(double p) const;
+
+    uint64_t total() const { return _total; }
+    uint64_t max() const { return _max; }
+
+    void clear();
+
+private:
+    static size_t index(uint64_t value) {
+        if(value < 2 * HALF) return value;
+        int shift = 63 - __builtin_clzll(value) - (SUB_BITS - 1);
+        return shift * HALF + (value >> shift);
+    }
+
+    static uint64_t highest(size_t index) {
+        if(index < 2 * HALF) return index;
+        int shift = index / HALF - 1;
+        uint64_t sub = index % HALF + HALF;
+        return ((sub + 1) << shift) - 1;
+    }
+
+private:
+    std::vector<uint64_t> _counts = std::vector<uint64_t>(BUCKETS);
+    uint64_t _total {};
+    uint64_t _max {};
+};
+
+inline void Histogram::merge(const Histogram &other) {
+    for(size_t i = 0; i < BUCKETS; ++i) {
+        _counts[i] += other._counts[i];
+    }
+    _total += other._total;
+    if(other._max > _max) _max = other._max;
+}
+
+inline uint64_t Histogram::percentile(double p) const {
+    uint64_t target = std::max<uint64_t>(1, p * _total + 0.5);
+    uint64_t seen = 0;
+    for(size_t i = 0; i < BUCKETS; ++i) {
+        seen += _counts[i];
+        if(seen >= target) return std::min(highest(i), _max);
+    }
+    return _max;
+}
+
+inline void Histogram::clear() {
+    std::fill(_counts.begin(), _counts.end(), 0);
+    _total = 0;
+    _max = 0;
+}
+
+} // co
@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include "Coroutine.h"
+
+namespace co {
+
+// internal
+// 所有co::local共用的slot下标分配
+inline std::atomic<size_t>& localIndices() {
+    static std::atomic<size_t> indices {};
+    return indices;
+}
+
+// 协程局部存储：每个协程各自持有一个T，首次访问时值初始化，协程退出时析构
+// 主协程也有自己的一份，与Environment同生命周期
+//
+// 同一线程上的协程共享thread_local变量，切换后就会互相覆盖
+// co::local则跟随协程，访问只是一次下标寻址
+//
+// usage:
+//      static co::local<std::string> requestId;
+//      *requestId = "jojo";
+//
+// Note: 每个local对象占用一个不回收的全局下标，应当是静态或者全局对象
+template <typename T>
+class local {
+public:
+    local(): _index(localIndices()++) {}
+
+    local(const local&) = delete;
+    local& operator=(const local&) = delete;
+
+    // 当前协程的值
+    T& get() { return get(Coroutine::current()); }
+    T& get(Coroutine &coroutine);
+
+    T& operator*() { return get(); }
+    T* operator->() { return &get(); }
+
+    // 当前协程是否已经持有值
+    bool has() const;
+
+    // 提前析构当前协程的值，下次访问时重新初始化
+    void reset();
+
+private:
+    static void destroy(void *value) { delete static_cast<T*>(value); }
+
+private:
+    size_t _index;
+};
+
+template <typename T>
+inline T& local<T>::get(Coroutine &coroutine) {
+    auto &locals = coroutine._locals;
+    if(_index < locals.size()) {
+        if(auto value = locals[_index].value) {
+            return *static_cast<T*>(value);
+        }
+    } else {
+        locals.resize(_index + 1, LocalValue{});
+    }
+    auto value = new T();
+    locals[_index] = {value, destroy};
+    return *value;
+}
+
+template <typename T>
+inline bool local<T>::has() const {
+    auto &locals = Coroutine::current()._locals;
+    return _index < locals.size() && locals[_index].value;
+}
+
+template <typename T>
+inline void local<T>::reset() {
+    auto &locals = Coroutine::current()._locals;
+    if(_index < locals.size() && locals[_index].value) {
+        auto value = locals[_index].value;
+        locals[_index].value = nullptr;
+        destroy(value);
+    }
+}
+
+} // co
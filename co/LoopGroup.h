@@ -0,0 +1,359 @@
+#pragma once
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "Coroutine.h"
+#include "Local.h"
+#include "posix.h"
+#include "Select.h"
+
+namespace co {
+
+// 多个loop()线程组成的组，用于在线程之间迁移连接
+// SO_REUSEPORT按四元组哈希分配连接，少数繁忙的会话可能占满一个loop()而其它线程空闲
+// 会话在两次请求之间调用rebalance()，当前loop过载时把fd连同新的处理协程交给最空闲的成员
+//
+// usage:
+//      static co::LoopGroup group;
+//      // 每个线程
+//      group.join();
+//      env.createCoroutine(listener, server)->resume();  // 以group.spawn(connection, session)启动会话
+//      co::loop();
+//
+//      void session(int fd) {
+//          for(;;) {
+//              /* 处理一个完整的请求 */
+//              if(group.rebalance(fd, session)) return;
+//          }
+//      }
+//
+// - 负载为最近一个采样周期内loop()不在epoll_wait中的时间比例，依赖Policy::STATISTICS
+// - 交接通过目标线程的mailbox（eventfd）完成，由目标loop()自己创建处理协程
+// - 迁移的只有fd，会话的其它状态需要由handler自行携带
+// - 迁出前以迁移之后的预估负载比较，迁入的会话至少停留dwell才能再次迁出，避免来回迁移
+//
+// Note: 成员数目在构造时确定，线程加入后不能退出，co::stop()之后不再接受迁入
+class LoopGroup {
+public:
+    using Handler = std::function<void(int)>;
+    using Milliseconds = std::chrono::milliseconds;
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static auto DEFAULT_INTERVAL = std::chrono::milliseconds(100);
+    constexpr static auto DEFAULT_DWELL = std::chrono::milliseconds(1000);
+    constexpr static auto DEFAULT_HIGH_LOAD = uint32_t(800);
+    constexpr static auto DEFAULT_MARGIN = uint32_t(200);
+    constexpr static auto DEFAULT_MAX_MIGRATIONS = size_t(8);
+
+    // 负载的采样周期
+    Milliseconds interval {DEFAULT_INTERVAL};
+    // 负载（千分比）不低于highLoad时才迁出，并且目标的负载至少低margin
+    uint32_t     highLoad {DEFAULT_HIGH_LOAD};
+    uint32_t     margin {DEFAULT_MARGIN};
+    // 每个采样周期内每个成员最多迁出的会话数目，避免一起涌向同一个空闲线程
+    size_t       maxMigrations {DEFAULT_MAX_MIGRATIONS};
+    // 迁入的会话至少停留这么久才能再次迁出
+    Milliseconds dwell {DEFAULT_DWELL};
+
+    explicit LoopGroup(size_t capacity = std::thread::hardware_concurrency());
+    ~LoopGroup();
+    LoopGroup(const LoopGroup&) = delete;
+    LoopGroup& operator=(const LoopGroup&) = delete;
+
+    // 当前线程加入，需要在loop()所在线程、并且在协程环境中或者loop()之前调用
+    // 返回成员下标，成员已满时返回-1（errno为ENOSPC）
+    int join();
+
+    // 在当前线程上启动一个计入负载统计的会话
+    void spawn(int fd, Handler handler);
+
+    // 当前loop过载并且存在更空闲的成员时，把fd交给对方由handler处理，返回true
+    // 返回true之后调用者不能再使用fd，应当直接返回
+    // 需要位于fd的两次I/O之间：fd上不能有尚未到来的关注事件，写合并的输出会先写出
+    bool rebalance(int fd, Handler handler);
+
+    size_t size() const { return _size.load(std::memory_order_acquire); }
+
+    // 成员的负载（千分比）、会话数目以及迁入迁出的次数，可以在任意线程读取
+    uint32_t load(size_t index) const { return _members[index].load; }
+    size_t sessions(size_t index) const { return _members[index].sessions; }
+    size_t migratedIn(size_t index) const { return _members[index].migratedIn; }
+    size_t migratedOut(size_t index) const { return _members[index].migratedOut; }
+
+private:
+    struct Handoff {
+        int fd;
+        Handler handler;
+        // 迁入的时间，由spawn()启动的会话为默认值
+        Clock::time_point arrived;
+    };
+
+    struct Member {
+        int eventfd {-1};
+        // 由其它线程投递、尚未创建处理协程的连接
+        std::mutex mutex;
+        std::vector<Handoff> inbox;
+        // 所属的loop()已经退出，不再接受投递
+        // 在mutex内写入，pick()不加锁读取
+        std::atomic<bool> closed {};
+
+        std::atomic<uint32_t> load {};
+        // 采样之后按迁入迁出的会话修正的预估负载
+        std::atomic<uint32_t> projected {};
+        std::atomic<size_t> sessions {};
+        std::atomic<size_t> migratedIn {};
+        std::atomic<size_t> migratedOut {};
+
+        // 以下只由所属线程访问
+        PollConfig *poll {};
+        uint64_t running {};
+        uint64_t blocked {};
+        size_t budget {};
+        // 迁入之后的若干个采样周期内不迁出，避免会话在两个loop之间来回迁移
+        size_t cooldown {};
+    };
+
+    // 当前线程对应的成员，未加入时为nullptr
+    Member* local();
+
+    // 所属线程上的mailbox协程：接收迁入的连接，并周期性地采样负载
+    void serve(Member &member);
+    void sample(Member &member);
+    void adopt(Member &member);
+
+    // 除self和已退出的成员以外预估负载最低的，负载相同时选会话较少的
+    Member* pick(Member *self);
+
+    bool post(Member &target, Handoff handoff);
+
+    void start(Member &member, Handoff handoff);
+
+    static void onSessionExit(void *argument);
+
+    // 每个会话协程迁入的时间
+    static co::local<Clock::time_point>& arrival();
+
+private:
+    std::unique_ptr<Member[]> _members;
+    size_t _capacity;
+    std::atomic<size_t> _size {};
+    std::mutex _joining;
+};
+
+inline LoopGroup::LoopGroup(size_t capacity)
+    : _members(new Member[std::max<size_t>(capacity, 1)]),
+      _capacity(std::max<size_t>(capacity, 1)) {}
+
+inline LoopGroup::~LoopGroup() {
+    for(size_t i = 0, n = size(); i < n; ++i) {
+        auto &member = _members[i];
+        for(auto &&handoff : member.inbox) {
+            ::close(handoff.fd);
+        }
+        ::close(member.eventfd);
+    }
+}
+
+inline int LoopGroup::join() {
+    std::lock_guard<std::mutex> _ {_joining};
+    size_t index = _size.load(std::memory_order_relaxed);
+    if(index == _capacity) {
+        errno = ENOSPC;
+        return -1;
+    }
+    auto &member = _members[index];
+    member.eventfd = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(member.eventfd < 0) {
+        return -1;
+    }
+    member.poll = &getPollConfig();
+    auto &statistics = Environment::instance().statistics();
+    member.running = statistics.runningNanoseconds;
+    member.blocked = statistics.blockedNanoseconds;
+    member.budget = maxMigrations;
+    // 之后其它线程才能看到这个成员
+    _size.store(index + 1, std::memory_order_release);
+    Environment::instance().createCoroutine([this, &member] { serve(member); })->resume();
+    return index;
+}
+
+inline LoopGroup::Member* LoopGroup::local() {
+    struct Cache {
+        LoopGroup *group;
+        Member *member;
+    };
+    static thread_local Cache cache {};
+    if(cache.group == this) {
+        return cache.member;
+    }
+    auto poll = &getPollConfig();
+    // 已退出的线程的PollConfig地址可能被新线程复用
+    for(size_t i = 0, n = size(); i < n; ++i) {
+        if(!_members[i].closed && _members[i].poll == poll) {
+            cache = {this, &_members[i]};
+            return cache.member;
+        }
+    }
+    return nullptr;
+}
+
+inline void LoopGroup::spawn(int fd, Handler handler) {
+    auto self = local();
+    if(!self) {
+        Environment::instance().createCoroutine(std::move(handler), fd)->resume();
+        return;
+    }
+    start(*self, {fd, std::move(handler), {}});
+}
+
+inline void LoopGroup::start(Member &member, Handoff handoff) {
+    ++member.sessions;
+    auto coroutine = Environment::instance().createCoroutine(std::move(handoff.handler), handoff.fd);
+    coroutine->onExit({onSessionExit, &member});
+    arrival().get(*coroutine) = handoff.arrived;
+    coroutine->resume();
+}
+
+inline void LoopGroup::onSessionExit(void *argument) {
+    --static_cast<Member*>(argument)->sessions;
+}
+
+inline co::local<LoopGroup::Clock::time_point>& LoopGroup::arrival() {
+    static co::local<Clock::time_point> arrival;
+    return arrival;
+}
+
+inline bool LoopGroup::rebalance(int fd, Handler handler) {
+    auto self = local();
+    // 快速路径：未过载
+    if(!self || self->projected < highLoad || self->budget == 0 || self->cooldown) {
+        return false;
+    }
+    auto now = Clock::now();
+    if(now - *arrival() < dwell) {
+        return false;
+    }
+    auto target = pick(self);
+    if(!target) {
+        return false;
+    }
+    // 近似认为负载平均分布在会话上
+    // 迁移之后目标仍然至少低margin才迁出，否则下一个周期又会迁回来
+    int64_t share = self->load / std::max<size_t>(self->sessions, 1);
+    int64_t source = self->projected;
+    if(int64_t(target->projected) + share + margin > source - share) {
+        return false;
+    }
+    auto &config = getPollConfig();
+    if(config.events.count(fd)) {
+        return false;
+    }
+    if(config.outputs.count(fd) && coalesce(fd, false)) {
+        return false;
+    }
+    if(!post(*target, {fd, std::move(handler), now})) {
+        return false;
+    }
+    self->projected -= share;
+    target->projected += share;
+    --self->budget;
+    ++self->migratedOut;
+    return true;
+}
+
+inline LoopGroup::Member* LoopGroup::pick(Member *self) {
+    Member *best = nullptr;
+    for(size_t i = 0, n = size(); i < n; ++i) {
+        auto &member = _members[i];
+        if(&member == self || member.closed) continue;
+        if(!best || member.projected < best->projected
+                || (member.projected == best->projected && member.sessions < best->sessions)) {
+            best = &member;
+        }
+    }
+    return best;
+}
+
+inline bool LoopGroup::post(Member &target, Handoff handoff) {
+    {
+        std::lock_guard<std::mutex> _ {target.mutex};
+        if(target.closed) return false;
+        target.inbox.emplace_back(std::move(handoff));
+    }
+    uint64_t one = 1;
+    // 计数已经溢出时同样会唤醒
+    ssize_t n = ::write(target.eventfd, &one, sizeof one);
+    (void)n;
+    return true;
+}
+
+inline void LoopGroup::adopt(Member &member) {
+    uint64_t count;
+    ssize_t n = ::read(member.eventfd, &count, sizeof count);
+    (void)n;
+    std::vector<Handoff> inbox;
+    {
+        std::lock_guard<std::mutex> _ {member.mutex};
+        inbox.swap(member.inbox);
+    }
+    // 迁入的会话还没有反映在负载中
+    if(!inbox.empty()) member.cooldown = 2;
+    for(auto &&handoff : inbox) {
+        ++member.migratedIn;
+        start(member, std::move(handoff));
+    }
+}
+
+inline void LoopGroup::sample(Member &member) {
+    auto &statistics = Environment::instance().statistics();
+    uint64_t running = statistics.runningNanoseconds;
+    uint64_t blocked = statistics.blockedNanoseconds;
+    uint64_t total = (running - member.running) + (blocked - member.blocked);
+    if(total > 0) {
+        member.load = uint32_t((running - member.running) * 1000 / total);
+    }
+    member.projected = uint32_t(member.load);
+    member.running = running;
+    member.blocked = blocked;
+    member.budget = maxMigrations;
+    if(member.cooldown) --member.cooldown;
+}
+
+inline void LoopGroup::serve(Member &member) {
+    auto next = Clock::now() + interval;
+    for(;;) {
+        int index = co::select({co::readable(member.eventfd), co::deadline(next)});
+        // 被取消，比如co::stop()
+        if(index < 0) break;
+        if(index == 0) {
+            adopt(member);
+        }
+        if(Clock::now() >= next) {
+            sample(member);
+            next = Clock::now() + interval;
+        }
+    }
+    std::vector<Handoff> inbox;
+    {
+        std::lock_guard<std::mutex> _ {member.mutex};
+        member.closed = true;
+        inbox.swap(member.inbox);
+    }
+    for(auto &&handoff : inbox) {
+        ::close(handoff.fd);
+    }
+    member.load = 0;
+    member.projected = 0;
+}
+
+} // co
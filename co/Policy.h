@@ -0,0 +1,59 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <unordered_map>
+#include "StackArena.h"
+
+namespace co {
+
+// Context的默认分配器之外的另一种选择：每次都从堆上分配
+// StackArena同样满足这个接口（static allocate / deallocate）
+struct HeapStackAllocator {
+    static void* allocate(size_t size) { return ::operator new(size); }
+    static void deallocate(void *pointer) { ::operator delete(pointer); }
+};
+
+// loop()的I/O后端，见posix.h
+// EpollBackend: epoll，默认
+// PollBackend: poll(2)，适用于fd很少或者不能使用epoll的场合
+struct EpollBackend;
+struct PollBackend;
+
+// 编译期配置，作为BasicEnvironment / BasicCoroutine / BasicContext的模板参数，并传递到posix.h
+// 关闭的特性在resume / yield / loop中不产生任何指令，对应的运行时开关不再起作用
+//
+// co::Environment即为BasicEnvironment<DefaultPolicy>
+// 自定义时继承DefaultPolicy，只覆盖需要修改的部分：
+//      struct Lean: co::DefaultPolicy {
+//          constexpr static bool STATISTICS = false;
+//          constexpr static bool TRACING = false;
+//      };
+//      auto &env = co::open<Lean>();
+//      env.createCoroutine(...)->resume();
+//      co::loop<Lean>();
+//
+// 不同配置的Environment是不同的类型，各自有独立的线程局部实例、协程和loop()，可以在同一个程序中共存
+// posix.h的接口都以配置为第一个模板参数，默认为DefaultPolicy，比如co::read<Lean>(fd, buf, size)
+//
+// Note: Select、TaskGroup、Generator等其余组件目前只用于DefaultPolicy
+struct DefaultPolicy {
+    // 每个协程栈的大小
+    constexpr static size_t STACK_SIZE = 1 << 17;
+    // 退出协程的Context回收栈容量，0表示不复用
+    constexpr static size_t RECYCLE_CAPACITY = 0xff;
+    // Statistics计数，关闭后所有计数恒为0，并且不支持co::preempt()
+    constexpr static bool STATISTICS = true;
+    // Environment::tracing()
+    constexpr static bool TRACING = true;
+    // Environment::accountCpu()以及paintStacks()
+    constexpr static bool PROFILING = true;
+    // Context的分配器，HeapStackAllocator或者StackArena
+    using StackAllocator = StackArena;
+    // loop()使用的I/O后端，EpollBackend或者PollBackend
+    using Backend = EpollBackend;
+    // loop()中按fd索引的各个表，需要提供unordered_map的find / emplace / erase / count以及遍历
+    template <typename Key, typename Value>
+    using EventTable = std::unordered_map<Key, Value>;
+};
+
+} // co
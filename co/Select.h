@@ -0,0 +1,402 @@
+#pragma once
+#include <unistd.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "Coroutine.h"
+#include "posix.h"
+
+namespace co {
+
+struct SelectCase;
+int select(const SelectCase *cases, size_t n);
+
+// 同一线程内的计数信号：notify()增加信号，tryWait() / wait()消费一个信号
+// 没有等待者时信号会保留，不会丢失
+//
+// 可以作为co::select的一个分支，见readable(Notification&)
+class Notification {
+    friend struct SelectWaiter;
+    friend int select(const SelectCase *cases, size_t n);
+
+public:
+    Notification() = default;
+    Notification(const Notification&) = delete;
+    Notification& operator=(const Notification&) = delete;
+
+    // 增加n个信号，并唤醒同样数目的等待者
+    void notify(size_t n = 1);
+
+    // 消费一个信号，没有信号时返回false
+    bool tryWait();
+
+    // 阻塞当前协程直到消费一个信号，被取消时返回false
+    bool wait();
+
+    size_t pending() const { return _count; }
+
+private:
+    void subscribe(Waker waker) { _waiters.emplace_back(waker); }
+    // 等待者已经被唤醒（不在队列中）时返回false
+    bool unsubscribe(Waker waker);
+    void wakeOne();
+
+private:
+    size_t _count {};
+    std::deque<Waker> _waiters;
+};
+
+// 同一线程内的无界队列，用于协程之间传递消息
+template <typename T>
+class Channel {
+public:
+    void push(T value) {
+        _queue.emplace_back(std::move(value));
+        _notification.notify();
+    }
+
+    // 队列为空时返回false
+    bool tryPop(T &value) {
+        if(!_notification.tryWait()) return false;
+        value = std::move(_queue.front());
+        _queue.pop_front();
+        return true;
+    }
+
+    // 阻塞当前协程直到取出一个消息，被取消时返回false
+    bool pop(T &value) {
+        if(!_notification.wait()) return false;
+        value = std::move(_queue.front());
+        _queue.pop_front();
+        return true;
+    }
+
+    size_t size() const { return _queue.size(); }
+    bool empty() const { return _queue.empty(); }
+
+    Notification& notification() { return _notification; }
+
+private:
+    std::deque<T> _queue;
+    Notification _notification;
+};
+
+// co::select的一个分支
+struct SelectCase {
+    enum Kind {
+        FD,
+        NOTIFICATION,
+        DEADLINE,
+    };
+
+    Kind                                  kind;
+    int                                   fd {-1};
+    Event::Type                           type {Event::READ};
+    Notification                          *notification {};
+    std::chrono::steady_clock::time_point deadline {};
+};
+
+inline SelectCase readable(int fd) {
+    return {SelectCase::FD, fd, Event::READ};
+}
+
+inline SelectCase writable(int fd) {
+    return {SelectCase::FD, fd, Event::WRITE};
+}
+
+inline SelectCase readable(Notification &notification) {
+    return {SelectCase::NOTIFICATION, -1, Event::READ, &notification};
+}
+
+template <typename T>
+inline SelectCase readable(Channel<T> &channel) {
+    return readable(channel.notification());
+}
+
+inline SelectCase deadline(std::chrono::steady_clock::time_point when) {
+    return {SelectCase::DEADLINE, -1, Event::READ, nullptr, when};
+}
+
+template <typename Rep, typename Period>
+inline SelectCase after(std::chrono::duration<Rep, Period> timeout) {
+    using namespace std::chrono;
+    return deadline(steady_clock::now() + duration_cast<steady_clock::duration>(timeout));
+}
+
+// 阻塞当前协程直到任意一个分支就绪，返回该分支的下标
+// 所有分支都在当前线程的loop()中登记，返回前撤销其余分支的登记
+//
+// usage:
+//      switch(co::select({co::readable(client), co::readable(upstream), co::after(timeout)})) {
+//          case 0: ...
+//          case 1: ...
+//          case 2: // 超时
+//      }
+//
+// - 与fd一样，分支就绪只表示可以尝试读写，select本身不消费数据或者信号
+// - 同时就绪时返回下标最小的分支
+// - 失败时返回-1并设置errno，比如fd的同一方向已经有其它协程在等待（EEXIST）
+//   或者当前协程被取消（ECANCELED）
+int select(const SelectCase *cases, size_t n);
+int select(std::initializer_list<SelectCase> cases);
+
+
+
+
+
+
+
+
+
+
+/// implement
+
+// internal
+// 一次select的所有分支共享的状态
+struct SelectWaiter {
+    struct Slot {
+        SelectWaiter *waiter;
+        size_t index;
+    };
+
+    // fired的特殊值：等待期间被取消
+    constexpr static int CANCELLED = std::numeric_limits<int>::max();
+
+    std::shared_ptr<Coroutine> coroutine;
+    // 最先就绪的分支
+    int fired {-1};
+
+    static void wake(void *argument);
+
+    // Coroutine::cancel()的回调，argument为SelectWaiter
+    static void abort(void *argument);
+
+    static Waker waker(Slot &slot) { return {wake, &slot}; }
+
+    // 分支尚未就绪时撤销登记
+    void cancel(const SelectCase &selectCase, Slot &slot);
+};
+
+inline void SelectWaiter::wake(void *argument) {
+    auto &slot = *static_cast<Slot*>(argument);
+    auto &waiter = *slot.waiter;
+    if(waiter.fired >= 0) return;
+    waiter.fired = slot.index;
+    getPollConfig().ready.emplace_back(waiter.coroutine);
+}
+
+inline void SelectWaiter::abort(void *argument) {
+    auto &waiter = *static_cast<SelectWaiter*>(argument);
+    if(waiter.fired >= 0) return;
+    waiter.fired = CANCELLED;
+    getPollConfig().ready.emplace_back(waiter.coroutine);
+}
+
+inline void SelectWaiter::cancel(const SelectCase &selectCase, Slot &slot) {
+    switch(selectCase.kind) {
+        case SelectCase::FD: {
+            // loop()已经移除了到来的事件
+            auto &events = getPollConfig().events;
+            auto iter = events.find(selectCase.fd);
+            if(iter != events.end() && iter->second.wakers[selectCase.type].argument == &slot) {
+                removeEvent(selectCase.fd, selectCase.type);
+            }
+            break;
+        }
+        case SelectCase::NOTIFICATION: {
+            auto &notification = *selectCase.notification;
+            // 被唤醒却没有选中这个分支，信号转交给下一个等待者
+            if(!notification.unsubscribe(waker(slot)) && notification.pending()) {
+                notification.wakeOne();
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+inline void Notification::notify(size_t n) {
+    _count += n;
+    for(; n && !_waiters.empty(); --n) {
+        wakeOne();
+    }
+}
+
+inline bool Notification::tryWait() {
+    if(!_count) return false;
+    --_count;
+    return true;
+}
+
+inline bool Notification::wait() {
+    while(!tryWait()) {
+        auto index = co::select({readable(*this)});
+        if(index < 0) return false;
+    }
+    return true;
+}
+
+inline bool Notification::unsubscribe(Waker waker) {
+    for(auto iter = _waiters.begin(); iter != _waiters.end(); ++iter) {
+        if(iter->wake == waker.wake && iter->argument == waker.argument) {
+            _waiters.erase(iter);
+            return true;
+        }
+    }
+    return false;
+}
+
+inline void Notification::wakeOne() {
+    if(_waiters.empty()) return;
+    auto waker = _waiters.front();
+    _waiters.pop_front();
+    waker();
+}
+
+inline int select(const SelectCase *cases, size_t n) {
+    using namespace std::chrono;
+    checkpoint();
+    if(n == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    constexpr static size_t CASES_USE_STACK = 16;
+    pollfd fdsSmall[CASES_USE_STACK];
+    SelectWaiter::Slot slotsSmall[CASES_USE_STACK];
+    std::vector<pollfd> fdsLarge;
+    std::vector<SelectWaiter::Slot> slotsLarge;
+    pollfd *fds = fdsSmall;
+    SelectWaiter::Slot *slots = slotsSmall;
+    if(n > CASES_USE_STACK) {
+        fdsLarge.resize(n);
+        slotsLarge.resize(n);
+        fds = fdsLarge.data();
+        slots = slotsLarge.data();
+    }
+
+    // try
+    // 只有fd分支需要一次非阻塞的::poll
+    nfds_t nfds = 0;
+    for(size_t i = 0; i < n; ++i) {
+        if(cases[i].kind == SelectCase::FD) {
+            fds[nfds++] = {cases[i].fd, short(cases[i].type == Event::READ ? POLLIN : POLLOUT), 0};
+        }
+    }
+    if(nfds && ::poll(fds, nfds, 0) < 0) {
+        return -1;
+    }
+    auto now = steady_clock::now();
+    for(size_t i = 0, j = 0; i < n; ++i) {
+        auto &selectCase = cases[i];
+        switch(selectCase.kind) {
+            case SelectCase::FD:
+                if(fds[j++].revents) return i;
+                break;
+            case SelectCase::NOTIFICATION:
+                if(selectCase.notification->pending()) return i;
+                break;
+            case SelectCase::DEADLINE:
+                if(selectCase.deadline <= now) return i;
+                break;
+        }
+    }
+
+    if(Coroutine::current().cancelled()) {
+        errno = ECANCELED;
+        return -1;
+    }
+
+    // 登记所有分支，deadline使用timerfd，与co::usleep一致
+
+    SelectWaiter waiter;
+    waiter.coroutine = Coroutine::current().shared_from_this();
+    int timerfd = -1;
+    size_t timerIndex = n;
+    size_t registered = 0;
+    int error = 0;
+    for(; registered < n && !error; ++registered) {
+        auto &selectCase = cases[registered];
+        auto &slot = slots[registered];
+        slot = {&waiter, registered};
+        switch(selectCase.kind) {
+            case SelectCase::FD: {
+                auto iter = addEvent(selectCase.fd, selectCase.type, SelectWaiter::waker(slot));
+                if(iter == getPollConfig().events.end()) error = EEXIST;
+                break;
+            }
+            case SelectCase::NOTIFICATION:
+                selectCase.notification->subscribe(SelectWaiter::waker(slot));
+                break;
+            case SelectCase::DEADLINE: {
+                // 多个deadline只需要最早的一个
+                if(timerfd >= 0) {
+                    if(selectCase.deadline >= cases[timerIndex].deadline) break;
+                    removeEvent(timerfd, Event::READ);
+                    ::close(timerfd);
+                }
+                timerIndex = registered;
+                timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+                if(timerfd < 0) {
+                    error = errno;
+                    break;
+                }
+                auto remain = duration_cast<nanoseconds>(selectCase.deadline - now).count();
+                itimerspec value {};
+                value.it_value.tv_sec = remain / 1000000000;
+                value.it_value.tv_nsec = remain % 1000000000;
+                if(::timerfd_settime(timerfd, 0, &value, nullptr)) {
+                    error = errno;
+                    break;
+                }
+                addEvent(timerfd, Event::READ, SelectWaiter::waker(slot));
+                break;
+            }
+        }
+    }
+
+    if(!error) {
+        auto &timers = Environment::instance().statistics().timers;
+        if(timerfd >= 0) ++timers;
+        {
+            Parking parking {{SelectWaiter::abort, &waiter}};
+            while(waiter.fired < 0) {
+                this_coroutine::yield();
+            }
+        }
+        if(timerfd >= 0) --timers;
+        if(waiter.fired == SelectWaiter::CANCELLED) error = ECANCELED;
+    }
+
+    for(size_t i = 0; i < registered; ++i) {
+        if(int(i) != waiter.fired && cases[i].kind != SelectCase::DEADLINE) {
+            waiter.cancel(cases[i], slots[i]);
+        }
+    }
+    if(timerfd >= 0) {
+        if(waiter.fired != int(timerIndex)) {
+            removeEvent(timerfd, Event::READ);
+        }
+        ::close(timerfd);
+    }
+    if(error) {
+        errno = error;
+        return -1;
+    }
+    return waiter.fired;
+}
+
+inline int select(std::initializer_list<SelectCase> cases) {
+    return select(cases.begin(), cases.size());
+}
+
+} // co
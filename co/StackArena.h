@@ -0,0 +1,219 @@
+#pragma once
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace co {
+
+// 协程栈（Context）的分配器，见Environment::useStackArena()
+//
+// 默认情况下每个Context单独从堆上分配，数千个128KiB的栈分散在地址空间各处，
+// 在协程之间切换时dTLB频繁失效
+// StackArena从2MiB大页组成的region中切出定长的slot：
+// - 优先MAP_HUGETLB，没有预留大页时退回到对齐的普通映射并madvise(MADV_HUGEPAGE)
+// - region通过mbind优先分配在启用时所在线程的NUMA节点上
+//
+// 每个slot前有一个header记录来源，因此无论是否启用都可以正确释放，也允许跨线程释放
+// 线程退出后，arena在最后一个slot归还时才解除映射
+class StackArena {
+public:
+    constexpr static size_t HUGE_PAGE = 1 << 21;
+    constexpr static size_t REGION_HUGE_PAGES = 16;
+    constexpr static size_t REGION_SIZE = HUGE_PAGE * REGION_HUGE_PAGES;
+    constexpr static size_t HEADER = 64;
+
+    // 为当前线程启用，slotSize为单个对象的大小
+    // 重复调用只是返回已有的arena
+    static StackArena* enable(size_t slotSize);
+    static void disable();
+
+    // 当前线程的arena，未启用时为nullptr
+    static StackArena* local() { return holder().arena; }
+
+    static void* allocate(size_t size);
+    static void deallocate(void *pointer);
+
+    // 绑定的NUMA节点，-1表示未绑定
+    int node() const { return _node; }
+    // region是否来自MAP_HUGETLB（否则为THP）
+    bool hugetlb() const { return _hugetlb; }
+    size_t regions() const;
+    size_t inUse() const;
+
+    StackArena(const StackArena&) = delete;
+    StackArena& operator=(const StackArena&) = delete;
+
+private:
+    struct Header {
+        StackArena *arena;
+    };
+
+    // 线程退出时释放对arena的引用
+    struct Holder {
+        StackArena *arena {};
+        ~Holder() { if(arena) arena->detach(); }
+    };
+
+    static Holder& holder() {
+        static thread_local Holder holder;
+        return holder;
+    }
+
+    explicit StackArena(size_t slotSize);
+    ~StackArena();
+
+    // 失败时返回nullptr，由调用者退回到堆上分配
+    Header* take(size_t size);
+    void give(Header *header);
+    void detach();
+
+    bool grow();
+
+private:
+    mutable std::mutex _mutex;
+    size_t _slotSize;
+    int _node {-1};
+    bool _hugetlb {};
+    bool _detached {};
+    size_t _inUse {};
+    std::vector<void*> _regions;
+    std::vector<Header*> _free;
+};
+
+inline StackArena* StackArena::enable(size_t slotSize) {
+    auto &arena = holder().arena;
+    if(!arena) {
+        arena = new StackArena(slotSize);
+    }
+    return arena;
+}
+
+inline void StackArena::disable() {
+    auto &arena = holder().arena;
+    if(arena) {
+        arena->detach();
+        arena = nullptr;
+    }
+}
+
+inline void* StackArena::allocate(size_t size) {
+    Header *header = nullptr;
+    if(auto arena = local()) {
+        header = arena->take(size);
+    }
+    if(!header) {
+        header = static_cast<Header*>(::operator new(size + HEADER));
+        header->arena = nullptr;
+    }
+    return reinterpret_cast<char*>(header) + HEADER;
+}
+
+inline void StackArena::deallocate(void *pointer) {
+    if(!pointer) return;
+    auto header = reinterpret_cast<Header*>(static_cast<char*>(pointer) - HEADER);
+    if(header->arena) {
+        header->arena->give(header);
+    } else {
+        ::operator delete(header);
+    }
+}
+
+inline size_t StackArena::regions() const {
+    std::lock_guard<std::mutex> _ {_mutex};
+    return _regions.size();
+}
+
+inline size_t StackArena::inUse() const {
+    std::lock_guard<std::mutex> _ {_mutex};
+    return _inUse;
+}
+
+inline StackArena::StackArena(size_t slotSize)
+    : _slotSize((slotSize + HEADER + HEADER - 1) / HEADER * HEADER) {
+    unsigned cpu, node;
+    // 不依赖libnuma
+    if(::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+        _node = node;
+    }
+}
+
+inline StackArena::~StackArena() {
+    for(auto region : _regions) {
+        ::munmap(region, REGION_SIZE);
+    }
+}
+
+inline StackArena::Header* StackArena::take(size_t size) {
+    std::lock_guard<std::mutex> _ {_mutex};
+    if(size + HEADER > _slotSize) return nullptr;
+    if(_free.empty() && !grow()) return nullptr;
+    auto header = _free.back();
+    _free.pop_back();
+    header->arena = this;
+    ++_inUse;
+    return header;
+}
+
+inline void StackArena::give(Header *header) {
+    bool last;
+    {
+        std::lock_guard<std::mutex> _ {_mutex};
+        _free.emplace_back(header);
+        last = --_inUse == 0 && _detached;
+    }
+    if(last) delete this;
+}
+
+inline void StackArena::detach() {
+    bool last;
+    {
+        std::lock_guard<std::mutex> _ {_mutex};
+        _detached = true;
+        last = _inUse == 0;
+    }
+    if(last) delete this;
+}
+
+inline bool StackArena::grow() {
+    constexpr int PROTECTION = PROT_READ | PROT_WRITE;
+    constexpr int FLAGS = MAP_PRIVATE | MAP_ANONYMOUS;
+    void *region = ::mmap(nullptr, REGION_SIZE, PROTECTION, FLAGS | MAP_HUGETLB, -1, 0);
+    bool hugetlb = region != MAP_FAILED;
+    if(!hugetlb) {
+        // 多映射一个大页用于对齐，再裁掉首尾
+        auto raw = ::mmap(nullptr, REGION_SIZE + HUGE_PAGE, PROTECTION, FLAGS, -1, 0);
+        if(raw == MAP_FAILED) return false;
+        auto address = reinterpret_cast<uintptr_t>(raw);
+        auto aligned = (address + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+        if(aligned > address) {
+            ::munmap(raw, aligned - address);
+        }
+        auto tail = HUGE_PAGE - (aligned - address);
+        if(tail) {
+            ::munmap(reinterpret_cast<void*>(aligned + REGION_SIZE), tail);
+        }
+        region = reinterpret_cast<void*>(aligned);
+        ::madvise(region, REGION_SIZE, MADV_HUGEPAGE);
+    }
+    if(_node >= 0 && _node < 64) {
+        // MPOL_PREFERRED：节点内存不足时仍然允许分配到其它节点
+        constexpr int PREFERRED = 1;
+        unsigned long mask = 1UL << _node;
+        ::syscall(SYS_mbind, region, REGION_SIZE, PREFERRED, &mask, 64, 0);
+    }
+    _hugetlb = hugetlb;
+    _regions.emplace_back(region);
+    // 逆序压栈，使得先分配低地址
+    auto base = static_cast<char*>(region);
+    for(size_t n = REGION_SIZE / _slotSize; n--;) {
+        _free.emplace_back(reinterpret_cast<Header*>(base + n * _slotSize));
+    }
+    return true;
+}
+
+} // co
@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include "EntryPoint.h"
+#include "Policy.h"
+
+namespace co {
+
+// internal
+constexpr size_t stackUsageBuckets(size_t stackSize) {
+    size_t n = 1;
+    for(size_t size = 1024; size < stackSize; size <<= 1) ++n;
+    return n;
+}
+
+// 按入口函数分组的栈使用情况（high-water mark）
+// 数据来自栈染色，见Environment::paintStacks()
+// StackSize即Policy::STACK_SIZE
+template <size_t StackSize>
+class BasicStackUsage {
+public:
+    // 以KiB为单位按2的幂分桶：<= 1K, 2K, 4K ... STACK_SIZE
+    constexpr static size_t BUCKETS = stackUsageBuckets(StackSize);
+
+    struct Record {
+        size_t count {};
+        size_t max {};
+        size_t histogram[BUCKETS] {};
+
+        void add(size_t bytes);
+    };
+
+    void record(const EntryPoint &entry, size_t bytes);
+
+    const std::map<EntryPoint, Record>& entries() const { return _entries; }
+    const Record& total() const { return _total; }
+
+    void clear() { _entries.clear(); _total = {}; }
+
+    // 每个入口一行：次数、最大值以及直方图
+    void dump(std::ostream &os) const;
+
+    static size_t bucket(size_t bytes);
+
+private:
+    std::map<EntryPoint, Record> _entries;
+    Record _total;
+};
+
+template <size_t StackSize>
+inline size_t BasicStackUsage<StackSize>::bucket(size_t bytes) {
+    size_t index = 0;
+    for(size_t limit = 1024; bytes > limit && index + 1 < BUCKETS; limit <<= 1) {
+        ++index;
+    }
+    return index;
+}
+
+template <size_t StackSize>
+inline void BasicStackUsage<StackSize>::Record::add(size_t bytes) {
+    ++count;
+    if(bytes > max) max = bytes;
+    ++histogram[bucket(bytes)];
+}
+
+template <size_t StackSize>
+inline void BasicStackUsage<StackSize>::record(const EntryPoint &entry, size_t bytes) {
+    _entries[entry].add(bytes);
+    _total.add(bytes);
+}
+
+template <size_t StackSize>
+inline void BasicStackUsage<StackSize>::dump(std::ostream &os) const {
+    auto line = [&os](const std::string &name, const Record &record) {
+        os << std::setw(8) << record.count << ' '
+           << std::setw(8) << record.max << " |";
+        for(auto n : record.histogram) os << ' ' << n;
+        os << " | " << name << '\n';
+    };
+    os << "   count      max | histogram (<=1K, 2K, 4K ...) | entry\n";
+    for(auto &&entry : _entries) {
+        line(entry.first.name(), entry.second);
+    }
+    line("(total)", _total);
+}
+
+using StackUsage = BasicStackUsage<DefaultPolicy::STACK_SIZE>;
+
+} // co
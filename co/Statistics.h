@@ -0,0 +1,164 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace co {
+
+// 单线程写入、任意线程读取的计数器
+// 写入方只有所属线程，因此不需要原子的read-modify-write
+template <bool Enabled>
+class BasicCounter {
+public:
+    using Value = uint64_t;
+
+    BasicCounter(Value value = 0): _value(value) {}
+    BasicCounter(const BasicCounter &rhs): _value(rhs.get()) {}
+    BasicCounter& operator=(const BasicCounter &rhs) { set(rhs.get()); return *this; }
+
+    Value get() const { return _value.load(std::memory_order_relaxed); }
+    void set(Value value) { _value.store(value, std::memory_order_relaxed); }
+
+    operator Value() const { return get(); }
+
+    BasicCounter& operator+=(Value delta) { set(get() + delta); return *this; }
+    BasicCounter& operator-=(Value delta) { set(get() - delta); return *this; }
+    BasicCounter& operator++() { return *this += 1; }
+    BasicCounter& operator--() { return *this -= 1; }
+
+private:
+    std::atomic<Value> _value;
+};
+
+// 关闭统计时的计数器，所有操作都是空的
+template <>
+class BasicCounter<false> {
+public:
+    using Value = uint64_t;
+
+    BasicCounter(Value = 0) {}
+
+    Value get() const { return 0; }
+    void set(Value) {}
+
+    operator Value() const { return 0; }
+
+    BasicCounter& operator+=(Value) { return *this; }
+    BasicCounter& operator-=(Value) { return *this; }
+    BasicCounter& operator++() { return *this; }
+    BasicCounter& operator--() { return *this; }
+};
+
+using Counter = BasicCounter<true>;
+
+template <bool Enabled>
+struct BasicStatistics;
+using Statistics = BasicStatistics<true>;
+
+// 每个Environment的调度统计，Enabled即Policy::STATISTICS
+// 拷贝即得到快照，Statistics::aggregate()汇总所有线程
+template <bool Enabled>
+struct BasicStatistics {
+    using Counter = BasicCounter<Enabled>;
+
+    // 协程
+    Counter switches;
+    Counter created;
+    Counter exited;
+    // Context复用：reuse()命中 / 未命中，recycle()回收 / 回收栈已满而释放
+    Counter recycleHits;
+    Counter recycleMisses;
+    Counter recycled;
+    Counter discarded;
+    // epoll
+    Counter polls;
+    Counter events;
+    Counter controls;
+    // addEvent因重复关注而失败
+    Counter duplicates;
+    // 当前等待中的定时器
+    Counter timers;
+    // 写合并的输出缓冲区调用::write的次数
+    Counter flushes;
+    // loop()阻塞于epoll_wait / 其余时间
+    Counter blockedNanoseconds;
+    Counter runningNanoseconds;
+
+    BasicStatistics& operator+=(const BasicStatistics &rhs);
+
+    // 所有线程的总和，包括已经退出的线程
+    // 关闭统计的Environment不计入
+    static Statistics aggregate();
+};
+
+// internal
+// 记录每个线程的Statistics，线程退出时并入retired
+class StatisticsRegistry {
+public:
+    static StatisticsRegistry& instance() {
+        static StatisticsRegistry registry;
+        return registry;
+    }
+
+    // 关闭统计时不需要登记
+    void attach(const BasicStatistics<false>*) {}
+    void detach(const BasicStatistics<false>*) {}
+
+    void attach(const Statistics *statistics) {
+        std::lock_guard<std::mutex> _ {_mutex};
+        _live.emplace_back(statistics);
+    }
+
+    void detach(const Statistics *statistics) {
+        std::lock_guard<std::mutex> _ {_mutex};
+        for(auto iter = _live.begin(); iter != _live.end(); ++iter) {
+            if(*iter == statistics) {
+                _retired += *statistics;
+                _live.erase(iter);
+                break;
+            }
+        }
+    }
+
+    Statistics aggregate() {
+        std::lock_guard<std::mutex> _ {_mutex};
+        Statistics result = _retired;
+        for(auto statistics : _live) {
+            result += *statistics;
+        }
+        return result;
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<const Statistics*> _live;
+    Statistics _retired;
+};
+
+template <bool Enabled>
+inline BasicStatistics<Enabled>& BasicStatistics<Enabled>::operator+=(const BasicStatistics &rhs) {
+    switches += rhs.switches;
+    created += rhs.created;
+    exited += rhs.exited;
+    recycleHits += rhs.recycleHits;
+    recycleMisses += rhs.recycleMisses;
+    recycled += rhs.recycled;
+    discarded += rhs.discarded;
+    polls += rhs.polls;
+    events += rhs.events;
+    controls += rhs.controls;
+    duplicates += rhs.duplicates;
+    timers += rhs.timers;
+    flushes += rhs.flushes;
+    blockedNanoseconds += rhs.blockedNanoseconds;
+    runningNanoseconds += rhs.runningNanoseconds;
+    return *this;
+}
+
+template <bool Enabled>
+inline Statistics BasicStatistics<Enabled>::aggregate() {
+    return StatisticsRegistry::instance().aggregate();
+}
+
+} // co
@@ -0,0 +1,389 @@
+#pragma once
+#if __has_include(<coroutine>) && defined(__cpp_impl_coroutine)
+#include <coroutine>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "Coroutine.h"
+#include "posix.h"
+
+// Task.h提供C++20无栈协程（co_await）与co的互操作
+// 需要-std=c++20，更低的标准下该文件为空
+//
+// 无栈协程只占用一个几百字节的堆上帧，适合转发消息这类轻量任务
+// 它和有栈协程共用同一个PollConfig / loop()
+//
+// - co::Task<T>       惰性启动的无栈协程，可以co_await其它Task
+// - co::detach(task)  启动并放手，结束后自行释放帧
+// - co::await(task)   在有栈协程中阻塞等待Task完成
+// - co_await co::join(coroutine)  在Task中等待有栈协程退出
+// - co::async::*      posix.h接口的awaitable版本
+//
+// Note: Task中不要调用co::read等有栈接口，它们要求位于有栈协程上下文
+
+namespace co {
+
+template <typename T = void>
+class Task;
+
+// internal
+inline void resumeHandle(void *address) {
+    std::coroutine_handle<>::from_address(address).resume();
+}
+
+// internal
+inline Waker makeWaker(std::coroutine_handle<> handle) {
+    return {resumeHandle, handle.address()};
+}
+
+// internal
+struct PromiseBase {
+    struct FinalAwaiter {
+        bool await_ready() noexcept { return false; }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept {
+            auto &promise = handle.promise();
+            if(promise.continuation) {
+                return promise.continuation;
+            }
+            if(auto joiner = promise.joiner) {
+                // joiner还在同步执行这个Task，直接返回即可
+                if(joiner != &Coroutine::current()) {
+                    joiner->resume();
+                }
+                return std::noop_coroutine();
+            }
+            if(promise.detached) {
+                if(promise.exception) std::terminate();
+                handle.destroy();
+            }
+            return std::noop_coroutine();
+        }
+
+        void await_resume() noexcept {}
+    };
+
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwaiter final_suspend() noexcept { return {}; }
+    void unhandled_exception() { exception = std::current_exception(); }
+
+    void rethrow() {
+        if(exception) std::rethrow_exception(exception);
+    }
+
+    // 等待者：无栈协程continuation或者有栈协程joiner，至多一个
+    std::coroutine_handle<> continuation;
+    Coroutine *joiner {};
+    std::exception_ptr exception;
+    bool detached {};
+};
+
+// internal
+template <typename T>
+struct Promise: PromiseBase {
+    Task<T> get_return_object();
+
+    template <typename U>
+    void return_value(U &&value) { result.emplace(std::forward<U>(value)); }
+
+    T take() {
+        rethrow();
+        return std::move(*result);
+    }
+
+    std::optional<T> result;
+};
+
+// internal
+template <>
+struct Promise<void>: PromiseBase {
+    Task<void> get_return_object();
+
+    void return_void() {}
+
+    void take() { rethrow(); }
+};
+
+template <typename T>
+class Task {
+public:
+    using promise_type = Promise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    // co_await另一个Task：对称式切入，完成后切回
+    struct Awaiter {
+        bool await_ready() { return handle.done(); }
+
+        Handle await_suspend(std::coroutine_handle<> continuation) {
+            handle.promise().continuation = continuation;
+            return handle;
+        }
+
+        T await_resume() { return handle.promise().take(); }
+
+        Handle handle;
+    };
+
+    explicit Task(Handle handle): _handle(handle) {}
+    ~Task() { if(_handle) _handle.destroy(); }
+
+    Task(Task &&rhs) noexcept: _handle(std::exchange(rhs._handle, {})) {}
+    Task& operator=(Task &&rhs) noexcept {
+        if(this != &rhs) {
+            if(_handle) _handle.destroy();
+            _handle = std::exchange(rhs._handle, {});
+        }
+        return *this;
+    }
+
+    Awaiter operator co_await() const& noexcept { return {_handle}; }
+
+    bool done() const { return !_handle || _handle.done(); }
+
+    Handle release() { return std::exchange(_handle, {}); }
+
+private:
+    Handle _handle;
+};
+
+template <typename T>
+inline Task<T> Promise<T>::get_return_object() {
+    return Task<T>{Task<T>::Handle::from_promise(*this)};
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+    return Task<void>{Task<void>::Handle::from_promise(*this)};
+}
+
+// 启动task并放手不管，结束后帧自行释放
+// 未捕获的异常会导致std::terminate()
+template <typename T>
+inline void detach(Task<T> task) {
+    auto handle = task.release();
+    handle.promise().detached = true;
+    handle.resume();
+}
+
+// 有栈协程等待无栈协程：启动task并让出，直到task完成
+// 只能在有栈协程中调用
+template <typename T>
+inline T await(Task<T> task) {
+    auto handle = task.release();
+    // 退出时统一释放帧
+    auto defer = [handle](void*) { handle.destroy(); };
+    std::unique_ptr<void, decltype(defer)> guard {handle.address(), defer};
+
+    handle.promise().joiner = &Coroutine::current();
+    handle.resume();
+    if(!handle.done()) {
+        // 由FinalAwaiter负责resume回来
+        this_coroutine::yield();
+    }
+    return handle.promise().take();
+}
+
+// 无栈协程等待有栈协程：co_await co::join(coroutine)
+// coroutine尚未启动的话会先resume它
+// Note: 每个有栈协程只允许一个等待者
+struct JoinAwaiter {
+    bool await_ready() {
+        if(!coroutine->running() && !coroutine->exit()) {
+            coroutine->resume();
+        }
+        return coroutine->exit();
+    }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+        coroutine->onExit(makeWaker(handle));
+    }
+
+    void await_resume() {}
+
+    std::shared_ptr<Coroutine> coroutine;
+};
+
+inline JoinAwaiter join(std::shared_ptr<Coroutine> coroutine) {
+    return {std::move(coroutine)};
+}
+
+namespace async {
+
+// internal
+// 单纯等待fd上的type事件，重复关注时返回-1
+struct EventAwaiter {
+    bool await_ready() { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto &poll = getPollConfig();
+        auto iter = addEvent(fd, type, makeWaker(handle));
+        if(iter == poll.events.end()) {
+            result = -1;
+            return false;
+        }
+        return true;
+    }
+
+    int await_resume() { return result; }
+
+    int fd;
+    Event::Type type;
+    int result {};
+};
+
+// internal
+// 先尝试一次，未就绪时在loop中关注type事件
+// 与posix.h的约定一致：重复关注时返回0
+template <typename Operation>
+struct IoAwaiter {
+    bool await_ready() {
+        result = operation();
+        return result >= 0 || errno != EAGAIN;
+    }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        auto &poll = getPollConfig();
+        auto iter = addEvent(fd, type, makeWaker(handle));
+        if(iter == poll.events.end()) {
+            result = 0;
+            return false;
+        }
+        suspended = true;
+        return true;
+    }
+
+    auto await_resume() {
+        if(suspended) result = operation();
+        return result;
+    }
+
+    int fd;
+    Event::Type type;
+    Operation operation;
+    decltype(std::declval<Operation>()()) result {};
+    bool suspended {};
+};
+
+template <typename Operation>
+inline IoAwaiter<Operation> makeIoAwaiter(int fd, Event::Type type, Operation operation) {
+    return {fd, type, std::move(operation)};
+}
+
+inline auto read(int fd, void *buf, size_t size) {
+    return makeIoAwaiter(fd, Event::READ, [=] { return ::read(fd, buf, size); });
+}
+
+inline auto write(int fd, const void *buf, size_t size) {
+    return makeIoAwaiter(fd, Event::WRITE, [=] { return ::write(fd, buf, size); });
+}
+
+inline auto accept4(int fd, sockaddr *addr, socklen_t *len, int flags) {
+    return makeIoAwaiter(fd, Event::READ, [=] { return ::accept4(fd, addr, len, flags); });
+}
+
+// internal
+// 基于timerfd的定时等待，返回0或者-1
+struct TimerAwaiter {
+    bool await_ready() { return nanoseconds.count() <= 0; }
+
+    bool await_suspend(std::coroutine_handle<> handle) {
+        timerfd = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if(timerfd < 0) {
+            result = -1;
+            return false;
+        }
+        itimerspec newValue {};
+        newValue.it_value.tv_sec = nanoseconds.count() / 1000000000;
+        newValue.it_value.tv_nsec = nanoseconds.count() % 1000000000;
+        auto &poll = getPollConfig();
+        if(::timerfd_settime(timerfd, 0, &newValue, nullptr)
+                || addEvent(timerfd, Event::READ, makeWaker(handle)) == poll.events.end()) {
+            ::close(timerfd);
+            timerfd = -1;
+            result = -1;
+            return false;
+        }
+        ++Environment::instance().statistics().timers;
+        return true;
+    }
+
+    int await_resume() {
+        if(timerfd >= 0) {
+            --Environment::instance().statistics().timers;
+            ::close(timerfd);
+        }
+        return result;
+    }
+
+    std::chrono::nanoseconds nanoseconds;
+    int timerfd {-1};
+    int result {};
+};
+
+inline TimerAwaiter sleep(unsigned int seconds) {
+    return {std::chrono::seconds(seconds)};
+}
+
+inline TimerAwaiter usleep(useconds_t usec) {
+    return {std::chrono::microseconds(usec)};
+}
+
+// 与co::connect相同的非阻塞connect和back-off重试
+inline Task<int> connect(int fd, const sockaddr *addr, socklen_t len) {
+    const size_t maxRetries = getPollConfig().connectRetries;
+    size_t retries = 0;
+
+    while(retries < maxRetries) {
+        // 0 - 0 - 0 - 1s - 2s - 4s - 8s - 16s - 32s - ...
+        if(retries++ > 2) {
+            co_await TimerAwaiter{std::chrono::milliseconds(1024 << (retries - 3))};
+        }
+
+        ::connect(fd, addr, len);
+
+        if(co_await EventAwaiter{fd, Event::WRITE}) {
+            errno = EPERM;
+            co_return -1;
+        }
+
+        int soerr;
+        socklen_t jojo = sizeof(soerr);
+        if(::getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &jojo)) {
+            errno = EPERM;
+            co_return -1;
+        }
+        switch(soerr) {
+            case 0:
+            case EINTR:
+            case EINPROGRESS:
+            case EALREADY:
+            case EISCONN:
+            {
+                sockaddr jojo;
+                socklen_t dio = sizeof jojo;
+                if(::getpeername(fd, &jojo, &dio)) {
+                    continue;
+                }
+                co_return 0;
+            }
+            case EAGAIN:
+            case EADDRINUSE:
+            case EADDRNOTAVAIL:
+            case ENETUNREACH:
+            case ECONNREFUSED:
+                continue;
+            default:
+                errno = soerr;
+                co_return -1;
+        }
+    }
+    errno = ETIMEDOUT;
+    co_return -1;
+}
+
+} // async
+} // co
+
+#endif
@@ -0,0 +1,323 @@
+#pragma once
+// std::optional / std::apply / if constexpr
+#if __cplusplus >= 201703L
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Coroutine.h"
+#include "posix.h"
+
+namespace co {
+
+class TaskGroup;
+template <typename T>
+class Future;
+struct TaskOrphans;
+
+// internal
+// 一个子任务的记录，存放在TaskGroup的slab中，子协程和Future只持有指针
+struct TaskChild {
+    TaskGroup *group {};
+    size_t index {};
+    std::shared_ptr<Coroutine> coroutine;
+    // 对应的Future，已经析构时为nullptr
+    class FutureBase *future {};
+    bool done {};
+    std::exception_ptr exception;
+    // TaskGroup已经析构而子协程尚未结束时，记录转交到这里
+    TaskOrphans *orphans {};
+};
+
+// internal
+// TaskGroup在非协程上下文中析构时无法等待，整个slab连同尚未结束的子任务转交给它
+// 由最后一个结束的子协程释放
+struct TaskOrphans {
+    std::deque<TaskChild> children;
+    size_t pending;
+};
+
+// internal
+class FutureBase {
+    friend class TaskGroup;
+
+public:
+    FutureBase(const FutureBase&) = delete;
+    FutureBase& operator=(const FutureBase&) = delete;
+
+    // 子任务是否已经结束（包括抛出异常）
+    bool ready() const { return !_child || _child->done; }
+
+    // 子任务在TaskGroup中的下标，与wait_any()的返回值对应
+    size_t index() const { return _index; }
+
+protected:
+    FutureBase(TaskGroup *group, TaskChild *child)
+        : _group(group), _child(child), _index(_child->index) {
+        _child->future = this;
+    }
+
+    ~FutureBase() { if(_child) _child->future = nullptr; }
+
+    // 派生类的成员构造完成后才能启动子协程
+    void start() { _child->coroutine->resume(); }
+
+    // 阻塞当前协程直到子任务结束，子任务的异常在这里重新抛出
+    void wait();
+
+protected:
+    TaskGroup *_group;
+    TaskChild *_child;
+    size_t _index;
+};
+
+// TaskGroup::spawn的结果
+// 值直接由子协程写入Future内部（std::optional），不需要额外的堆分配
+//
+// Note1: Future不可移动，依赖C++17的guaranteed copy elision从spawn返回
+// Note2: 不要让Future比TaskGroup活得更久
+template <typename T>
+class Future: public FutureBase {
+    friend class TaskGroup;
+
+public:
+    // 等待并取得结果
+    T& get() {
+        wait();
+        return *_value;
+    }
+
+private:
+    Future(TaskGroup *group, TaskChild *child)
+        : FutureBase(group, child) { start(); }
+
+    template <typename U>
+    void set(U &&value) { _value.emplace(std::forward<U>(value)); }
+
+private:
+    std::optional<T> _value;
+};
+
+template <>
+class Future<void>: public FutureBase {
+    friend class TaskGroup;
+
+public:
+    void get() { wait(); }
+
+private:
+    Future(TaskGroup *group, TaskChild *child)
+        : FutureBase(group, child) { start(); }
+};
+
+// 结构化的并发：在当前线程上fan-out多个子协程，再gather结果
+// 请求延迟从各个后端之和变为其中的最大值，不需要额外的线程
+//
+// usage:
+//      co::TaskGroup group;
+//      auto user = group.spawn(fetchUser, id);
+//      auto feed = group.spawn(fetchFeed, id);
+//      group.wait_all();
+//      render(user.get(), feed.get());
+//
+// - spawn立即启动子协程，直到它第一次阻塞才返回
+// - 子协程抛出异常时，异常保存到对应的Future，并且（默认）取消整个组
+// - 取消时阻塞在co::接口中的子协程以ECANCELED返回（见Coroutine::cancel），其余时候通过cancelled()自行检查
+// - 等待者被取消时同样取消整个组，但仍然等到子协程结束
+// - 析构时等待所有子协程结束
+// - 子任务的记录存放在组内的slab（std::deque）中，除了子协程本身以外只有slab按块扩容时分配内存
+//
+// Note: wait系列接口只能在协程中调用，同一时间只允许一个等待者，唤醒经由loop()的就绪队列
+class TaskGroup {
+    friend class FutureBase;
+
+public:
+    constexpr static size_t npos = size_t(-1);
+
+    // 有子协程失败时是否取消整个组
+    bool cancelOnFailure {true};
+
+    TaskGroup() = default;
+    ~TaskGroup();
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    template <typename Entry, typename ...Args,
+              typename R = std::invoke_result_t<std::decay_t<Entry>&, std::decay_t<Args>&...>>
+    Future<R> spawn(Entry &&entry, Args &&...arguments);
+
+    // 等待所有子协程结束
+    void wait_all();
+
+    // 按结束的先后顺序返回一个尚未返回过的子协程下标
+    // 所有子协程都已返回过时为npos
+    size_t wait_any();
+
+    void cancel();
+    bool cancelled() const { return _cancelled; }
+
+    // 子协程数目和尚未结束的数目
+    size_t size() const { return _children.size(); }
+    size_t pending() const { return _pending; }
+
+    // 第一个失败的子协程的异常
+    std::exception_ptr exception() const { return _exception; }
+
+private:
+    template <typename R, typename Entry, typename ...Args>
+    struct TaskEntry;
+
+    static void onChildExit(void *argument);
+
+    // 等待者被取消，Parking的canceller
+    static void onWaiterCancel(void *argument);
+
+    void complete(TaskChild &child);
+
+    template <typename Predicate>
+    void waitUntil(Predicate predicate);
+
+private:
+    // 元素的地址在扩容时保持不变，子协程和Future直接持有指针
+    std::deque<TaskChild> _children;
+    // 结束顺序，以及wait_any()已经返回到的位置
+    std::vector<size_t> _completed;
+    size_t _cursor {};
+    size_t _pending {};
+    bool _cancelled {};
+    std::exception_ptr _exception;
+    std::shared_ptr<Coroutine> _waiter;
+};
+
+template <typename Entry, typename ...Args, typename R>
+inline Future<R> TaskGroup::spawn(Entry &&entry, Args &&...arguments) {
+    auto &child = _children.emplace_back();
+    child.group = this;
+    child.index = _children.size() - 1;
+    child.coroutine = Environment::instance().createCoroutine(
+        TaskEntry<R, std::decay_t<Entry>, std::decay_t<Args>...> {
+            &child, std::forward<Entry>(entry), {std::forward<Args>(arguments)...}});
+    child.coroutine->onExit({onChildExit, &child});
+    // 已取消的组中新建的子协程同样是取消状态
+    if(_cancelled) child.coroutine->cancel();
+    ++_pending;
+    // guaranteed copy elision，Future在调用者处原地构造后才启动子协程
+    return Future<R>{this, &child};
+}
+
+// 子协程的入口，Coroutine只以const方式调用，因此成员为mutable
+template <typename R, typename Entry, typename ...Args>
+struct TaskGroup::TaskEntry {
+    TaskChild *child;
+    mutable Entry entry;
+    mutable std::tuple<Args...> arguments;
+
+    void operator()() const {
+        try {
+            if constexpr(std::is_void<R>::value) {
+                std::apply(entry, arguments);
+            } else {
+                auto &&value = std::apply(entry, arguments);
+                if(child->future) {
+                    static_cast<Future<R>*>(child->future)->set(std::forward<decltype(value)>(value));
+                }
+            }
+        } catch(...) {
+            child->exception = std::current_exception();
+        }
+    }
+};
+
+inline void TaskGroup::onChildExit(void *argument) {
+    auto &child = *static_cast<TaskChild*>(argument);
+    child.done = true;
+    if(child.group) {
+        child.group->complete(child);
+    } else if(child.orphans && --child.orphans->pending == 0) {
+        // 当前协程仍由Environment持有，释放记录是安全的
+        delete child.orphans;
+    }
+}
+
+inline void TaskGroup::onWaiterCancel(void *argument) {
+    static_cast<TaskGroup*>(argument)->cancel();
+}
+
+inline void TaskGroup::cancel() {
+    if(_cancelled) return;
+    _cancelled = true;
+    for(auto &&child : _children) {
+        if(!child.done) child.coroutine->cancel();
+    }
+}
+
+inline void TaskGroup::complete(TaskChild &child) {
+    --_pending;
+    _completed.emplace_back(child.index);
+    if(child.exception && !_exception) {
+        _exception = child.exception;
+        if(cancelOnFailure) cancel();
+    }
+    // 等待者自行检查条件，不满足时会再次等待
+    if(_waiter) {
+        getPollConfig().ready.emplace_back(std::move(_waiter));
+        _waiter = nullptr;
+    }
+}
+
+template <typename Predicate>
+inline void TaskGroup::waitUntil(Predicate predicate) {
+    auto &coroutine = Coroutine::current();
+    while(!predicate()) {
+        if(coroutine.cancelled()) cancel();
+        _waiter = coroutine.shared_from_this();
+        Parking parking {{onWaiterCancel, this}};
+        this_coroutine::yield();
+    }
+}
+
+inline void TaskGroup::wait_all() {
+    waitUntil([this] { return _pending == 0; });
+}
+
+inline size_t TaskGroup::wait_any() {
+    waitUntil([this] { return _cursor < _completed.size() || _cursor == _children.size(); });
+    return _cursor < _completed.size() ? _completed[_cursor++] : npos;
+}
+
+inline TaskGroup::~TaskGroup() {
+    if(_pending && Coroutine::test()) {
+        wait_all();
+    }
+    // 非协程上下文中无法等待，剩下的子协程结束后不再通知
+    for(auto &&child : _children) {
+        child.group = nullptr;
+        if(child.future) {
+            child.future->_group = nullptr;
+        }
+    }
+    if(_pending) {
+        auto orphans = new TaskOrphans {std::move(_children), _pending};
+        for(auto &&child : orphans->children) {
+            child.orphans = orphans;
+        }
+    }
+}
+
+inline void FutureBase::wait() {
+    if(_group && !_child->done) {
+        _group->waitUntil([this] { return _child->done; });
+    }
+    if(_child->exception) {
+        std::rethrow_exception(_child->exception);
+    }
+}
+
+} // co
+
+#endif
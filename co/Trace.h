@@ -0,0 +1,227 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "CpuTime.h"
+#include "EntryPoint.h"
+
+namespace co {
+
+// 每个线程的事件跟踪，导出为Chrome trace（Perfetto同样可以打开）
+//
+// 协程切换、退出、fd关注和唤醒以及epoll_wait都记录到一个定长的环形缓冲区
+// 时间戳为TSC，只有所属线程写入，不需要加锁
+// 关闭时每个记录点只是一次分支判断
+class Trace {
+public:
+    constexpr static size_t DEFAULT_CAPACITY = 1 << 16;
+
+    enum Kind: uint8_t {
+        START,    // 协程首次切入，附带入口
+        SWITCH,   // coroutine -> peer
+        EXIT,
+        REGISTER, // coroutine关注fd上的type事件
+        WAKEUP,   // loop因fd上的事件唤醒coroutine
+        POLL,     // epoll_wait返回，fd为就绪事件数
+    };
+
+    struct Record {
+        uint64_t tsc;
+        const void *coroutine;
+        const void *peer;
+        EntryPoint entry;
+        int fd;
+        Kind kind;
+        uint8_t type;
+    };
+
+    // capacity向上取整为2的幂
+    // main为主协程，导出时对应第一行
+    void enable(const void *main, size_t capacity = DEFAULT_CAPACITY);
+    void disable() { _enabled = false; }
+    bool enabled() const { return _enabled; }
+
+    void record(Kind kind, const void *coroutine, const void *peer = nullptr,
+                int fd = -1, int type = 0, EntryPoint entry = {}) {
+        if(!_enabled) return;
+        auto head = _head.load(std::memory_order_relaxed);
+        _records[head & _mask] = {Tsc::now(), coroutine, peer, entry, fd, kind,
+                                  static_cast<uint8_t>(type)};
+        _head.store(head + 1, std::memory_order_release);
+    }
+
+    // 包括已经被覆盖的记录
+    uint64_t total() const { return _head.load(std::memory_order_acquire); }
+
+    // 输出Chrome trace JSON，每个协程一行，显示运行和阻塞的区间
+    // 多个线程的trace可以用不同的pid区分
+    //
+    // Note: 在其它线程导出时，正在被覆盖的最旧记录可能不完整
+    void dump(std::ostream &os, int pid = 1) const;
+
+private:
+    static void escape(std::ostream &os, const std::string &text);
+
+private:
+    bool _enabled {};
+    const void *_main {};
+    std::unique_ptr<Record[]> _records;
+    size_t _mask {};
+    std::atomic<uint64_t> _head {};
+};
+
+inline void Trace::enable(const void *main, size_t capacity) {
+    size_t size = 1;
+    while(size < capacity) size <<= 1;
+    if(size != _mask + 1 || !_records) {
+        _records.reset(new Record[size]);
+        _mask = size - 1;
+        _head.store(0, std::memory_order_relaxed);
+    }
+    _main = main;
+    Tsc::cyclesPerNanosecond();
+    _enabled = true;
+}
+
+inline void Trace::escape(std::ostream &os, const std::string &text) {
+    os << '"';
+    for(auto c : text) {
+        if(c == '"' || c == '\\') os << '\\';
+        if(static_cast<unsigned char>(c) >= 0x20) os << c;
+    }
+    os << '"';
+}
+
+inline void Trace::dump(std::ostream &os, int pid) const {
+    struct Row {
+        int tid;
+        bool running;
+        uint64_t runStart;
+        // 让出前关注过fd，切出后即为阻塞
+        bool pending;
+        bool blocked;
+        uint64_t blockStart;
+        int fd;
+        int type;
+    };
+
+    auto head = total();
+    auto tail = head > _mask + 1 ? head - _mask - 1 : 0;
+    if(head == tail) {
+        os << "{\"traceEvents\":[]}\n";
+        return;
+    }
+    uint64_t base = _records[tail & _mask].tsc;
+    auto us = [base](uint64_t tsc) {
+        return tsc > base ? Tsc::toNanoseconds(tsc - base) / 1e3 : 0.0;
+    };
+
+    std::unordered_map<const void*, Row> rows;
+    int tids = 0;
+    bool first = true;
+    auto begin = [&](const char *ph, const Row &row, uint64_t tsc) -> std::ostream& {
+        os << (first ? "\n" : ",\n");
+        first = false;
+        return os << "{\"ph\":\"" << ph << "\",\"pid\":" << pid
+                  << ",\"tid\":" << row.tid << ",\"ts\":" << us(tsc);
+    };
+    auto name = [&](const Row &row, const std::string &text) {
+        begin("M", row, base) << ",\"name\":\"thread_name\",\"args\":{\"name\":";
+        escape(os, text);
+        os << "}}";
+    };
+    auto create = [&](const void *coroutine) -> Row& {
+        auto &row = rows[coroutine];
+        row = {};
+        row.tid = tids++;
+        return row;
+    };
+    auto find = [&](const void *coroutine) -> Row& {
+        if(!coroutine) coroutine = _main;
+        auto iter = rows.find(coroutine);
+        if(iter != rows.end()) return iter->second;
+        auto &row = create(coroutine);
+        name(row, coroutine == _main ? "main" : "coroutine");
+        return row;
+    };
+    auto complete = [&](const Row &row, const char *what, uint64_t start, uint64_t end) {
+        begin("X", row, start) << ",\"dur\":" << us(end) - us(start)
+                               << ",\"name\":\"" << what << "\"";
+        if(what[0] == 'b') {
+            os << ",\"args\":{\"fd\":" << row.fd << ",\"type\":" << row.type << "}";
+        }
+        os << "}";
+    };
+    auto instant = [&](const Row &row, uint64_t tsc, const char *what, const char *key, int value) {
+        begin("i", row, tsc) << ",\"s\":\"t\",\"name\":\"" << what << "\"";
+        if(key) os << ",\"args\":{\"" << key << "\":" << value << "}";
+        os << "}";
+    };
+
+    os << "{\"traceEvents\":[";
+    find(_main);
+    uint64_t last = base;
+    for(auto index = tail; index != head; ++index) {
+        auto &record = _records[index & _mask];
+        last = record.tsc;
+        switch(record.kind) {
+            case START: {
+                auto &row = create(record.coroutine);
+                name(row, record.entry.name());
+                break;
+            }
+            case SWITCH: {
+                auto &from = find(record.coroutine);
+                if(from.running) {
+                    complete(from, "running", from.runStart, record.tsc);
+                    from.running = false;
+                }
+                if(from.pending) {
+                    from.pending = false;
+                    from.blocked = true;
+                    from.blockStart = record.tsc;
+                }
+                auto &to = find(record.peer);
+                if(to.blocked) {
+                    complete(to, "blocked", to.blockStart, record.tsc);
+                    to.blocked = false;
+                }
+                to.running = true;
+                to.runStart = record.tsc;
+                break;
+            }
+            case EXIT:
+                instant(find(record.coroutine), record.tsc, "exit", nullptr, 0);
+                break;
+            case REGISTER: {
+                auto &row = find(record.coroutine);
+                if(record.coroutine) {
+                    row.pending = true;
+                    row.fd = record.fd;
+                    row.type = record.type;
+                }
+                instant(row, record.tsc, "register", "fd", record.fd);
+                break;
+            }
+            case WAKEUP:
+                instant(find(record.coroutine), record.tsc, "wakeup", "fd", record.fd);
+                break;
+            case POLL:
+                instant(find(_main), record.tsc, "epoll_wait", "events", record.fd);
+                break;
+        }
+    }
+    // 尚未结束的区间截止到最后一条记录
+    for(auto &&entry : rows) {
+        auto &row = entry.second;
+        if(row.running) complete(row, "running", row.runStart, last);
+        if(row.blocked) complete(row, "blocked", row.blockStart, last);
+    }
+    os << "\n]}\n";
+}
+
+} // co
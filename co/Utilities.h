@@ -4,18 +4,26 @@
 namespace co {
 namespace this_coroutine {
 
+template <typename Policy = DefaultPolicy>
 inline void yield() {
-    return ::co::Coroutine::yield();
+    return ::co::BasicCoroutine<Policy>::yield();
+}
+
+template <typename Policy>
+inline bool transfer(BasicCoroutine<Policy> &target) {
+    return ::co::BasicCoroutine<Policy>::transfer(target);
 }
 
 } // this_coroutine
 
+template <typename Policy = DefaultPolicy>
 inline bool test() {
-    return Coroutine::test();
+    return BasicCoroutine<Policy>::test();
 }
 
-inline Environment& open() {
-    return Environment::instance();
+template <typename Policy = DefaultPolicy>
+inline BasicEnvironment<Policy>& open() {
+    return BasicEnvironment<Policy>::instance();
 }
 
-} // co
\ No newline at end of file
+} // co
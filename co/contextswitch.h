@@ -1,19 +1,18 @@
 #pragma once
 namespace co {
 
-class Context;
-
-// 可以安全地在gcc8及以上版本使用
-// 否则需要避免-O0
+// 需要gcc8及以上版本（x86的naked属性）
 //
 // 由于不确定C++ ABI有啥坑，这里还是老实用上extern "C"
 // 关于attribute：
 // 1. 必须要no inline，保证rdi和rsi传递，否则很容易代码层面地inline（导致rsi没传递）
 // 2. weak保证C++ inline作用，既weak符号，用于header-only库
-// 3. optimize("O3")相当于即使你用O0编译整个程序，这一段代码也会用O3去编，
-//    因为O0会生成多余的push/pop指令导致crash
-extern "C" __attribute__((noinline, weak, optimize("O3")))
-void contextSwitch(Context* prev /*%rdi*/, Context *next /*%rsi*/) {
+// 3. naked使得函数体完全由下面的汇编组成，不受优化等级影响，ret也由汇编给出
+//    函数内从不改动rsp以外的栈，因此编译器生成的CFI（CFA = rsp + 8）始终成立，
+//    切换前后(%rsp)都是有效的返回地址，perf / gdb在任何一条指令处都能正确回溯
+// 参数为BasicContext，与配置无关，寄存器总是位于其内存布局的最顶端
+extern "C" __attribute__((noinline, weak, naked))
+void contextSwitch(void *prev /*%rdi*/, void *next /*%rsi*/) {
     asm volatile(R"(
         movq %rsp, %rax
         movq %rax, 104(%rdi)
@@ -32,8 +31,8 @@ void contextSwitch(Context* prev /*%rdi*/, Context *next /*%rsi*/) {
         movq %r14, 8(%rdi)
         movq %r15, (%rdi)
 
-        movq 48(%rsi), %rbp
         movq 104(%rsi), %rsp
+        movq 48(%rsi), %rbp
         movq (%rsi), %r15
         movq 8(%rsi), %r14
         movq 16(%rsi), %r13
@@ -50,15 +49,15 @@ void contextSwitch(Context* prev /*%rdi*/, Context *next /*%rsi*/) {
 
         movq %rax, (%rsp)
         xorq %rax, %rax
+        ret
     )");
-    // 这里由gcc直接生成ret指令
 }
 
-extern "C" __attribute__((noinline, weak, optimize("O3")))
-void contextSwitchOnly(Context *next/*%rdi*/) {
+extern "C" __attribute__((noinline, weak, naked))
+void contextSwitchOnly(void *next/*%rdi*/) {
     asm volatile(R"(
-        movq 48(%rdi), %rbp
         movq 104(%rdi), %rsp
+        movq 48(%rdi), %rbp
         movq (%rdi), %r15
         movq 8(%rdi), %r14
         movq 16(%rdi), %r13
@@ -75,6 +74,25 @@ void contextSwitchOnly(Context *next/*%rdi*/) {
 
         movq %rax, (%rsp)
         xorq %rax, %rax
+        ret
+    )");
+}
+
+// 新协程的第一个栈帧，由contextSwitch的ret进入
+// 此时rdi为参数，r12为真正的入口（见Context::fillRegisters）
+//
+// - .cfi_undefined rip：DWARF回溯（gdb、perf --call-graph=dwarf、异常）到此为止
+// - rbp清零并压入空的返回地址：帧指针回溯（perf -g）同样到此为止
+// - 16字节对齐后call，入口函数看到的是标准的栈布局
+// - 入口函数不允许返回
+extern "C" __attribute__((noinline, weak, naked))
+void contextEntry() {
+    asm volatile(R"(
+        .cfi_undefined rip
+        xorl %ebp, %ebp
+        pushq $0
+        call *%r12
+        ud2
     )");
 }
 
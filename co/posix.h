@@ -1,19 +1,33 @@
 #pragma once
 #include <unistd.h>
 #include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/syscall.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/timerfd.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
 #include <algorithm>
+#include <cstdint>
 #include <array>
 #include <chrono>
+#include <deque>
 #include <unordered_map>
 #include <map>
 #include <memory>
 #include <iostream>
+#include "Buffer.h"
 #include "Coroutine.h"
 #include "Utilities.h"
 
+// 较旧的glibc没有公开SIGEV_THREAD_ID所需的字段名
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
 // posix.h文件提供一些常见POSIX接口的协程改造
 // 比如用co::read替代::read
 //
@@ -24,24 +38,96 @@
 
 namespace co {
 
-struct PollConfig;
-struct Event;
+template <typename Policy> struct BasicEvent;
+using Event = BasicEvent<DefaultPolicy>;
+using PollConfig = BasicPollConfig<DefaultPolicy>;
 
 /// interface
 
+// 模板参数Policy为协程所属Environment的配置，默认为DefaultPolicy，见Policy.h
+
+template <typename Policy = DefaultPolicy>
 ssize_t read(int fd, void *buf, size_t size);
+template <typename Policy = DefaultPolicy>
 ssize_t write(int fd, void *buf, size_t size);
+// 等到fd可读时才从当前线程的BufferPool借出缓冲区并读取
+// 返回值与read一致，仅当返回值 > 0时buffer有效
+template <typename Policy = DefaultPolicy>
+ssize_t readPooled(int fd, Buffer &buffer);
+template <typename Policy = DefaultPolicy>
 int connect(int fd, const sockaddr *addr, socklen_t len);
+template <typename Policy = DefaultPolicy>
 int accept4(int fd, sockaddr *addr, socklen_t *len, int flags);
-
+// 批量accept：阻塞直到有新连接，然后一次唤醒最多接受max个，依次写入connections
+// 返回接受的数目，失败时返回-1
+template <typename Policy = DefaultPolicy>
+int acceptBatch(int fd, int *connections, size_t max, int flags);
+// 多个协程共享listening fd：开启后fd在loop()中常驻关注（edge-triggered），不再每次唤醒都epoll_ctl
+// co::accept4 / co::acceptBatch的等待者排队，每次就绪只唤醒一个，接受满额时再唤醒下一个
+// 关闭时仍在等待的协程返回-1（errno为EBADF），close(fd)之前必须关闭
+template <typename Policy = DefaultPolicy>
+int shareListener(int fd, bool enable = true);
+
+// 批量收发UDP datagram，一次系统调用处理vlen个消息
+template <typename Policy = DefaultPolicy>
+int recvmmsg(int fd, mmsghdr *msgvec, unsigned int vlen, int flags);
+template <typename Policy = DefaultPolicy>
+int sendmmsg(int fd, mmsghdr *msgvec, unsigned int vlen, int flags);
+// UDP GSO：每个发送的buffer由内核按segmentSize切分成多个datagram
+int setUdpSegment(int fd, int segmentSize);
+// UDP GRO：接收时内核合并同一流的datagram，切分大小见groSegmentSize
+int setUdpGro(int fd, bool enable = true);
+int groSegmentSize(const msghdr &msg);
+
+template <typename Policy = DefaultPolicy>
 unsigned int sleep(unsigned int seconds);
+template <typename Policy = DefaultPolicy>
 int usleep(useconds_t usec);
 
+template <typename Policy = DefaultPolicy>
 int poll(struct pollfd *fds, nfds_t nfds, int timeout);
 
-PollConfig& getPollConfig();
+// 写合并：开启后co::write只追加到fd的输出缓冲区
+// 缓冲区超过阈值，或者loop()处理完当前一批就绪事件时，用一次write写出
+// 关闭时会先flush，close(fd)之前必须关闭写合并
+template <typename Policy = DefaultPolicy>
+int coalesce(int fd, bool enable = true);
+
+// 设置socket的SO_BUSY_POLL，由内核在读取时忙轮询网卡队列
+// 通常需要CAP_NET_ADMIN
+int setBusyPoll(int fd, std::chrono::microseconds budget);
+// 阻塞当前协程直到fd的输出缓冲区全部写出
+template <typename Policy = DefaultPolicy>
+int flush(int fd);
+
+// 抢占：当前线程上的协程连续运行超过budget（按线程CPU时间）后，
+// 在下一个安全点让出并排到loop()的就绪队列末尾
+// 安全点为co::的各个接口以及co::this_coroutine::maybe_yield()
+// hard为true时，位于Preemptible作用域内的协程直接在信号处理函数中让出
+// budget为0时关闭
+// Note: 每个线程只有一个抢占定时器，作用于最近一次调用preempt()的Environment
+template <typename Policy = DefaultPolicy>
+int preempt(std::chrono::microseconds budget, bool hard = false);
+
+namespace this_coroutine {
+// 安全点：时间片用完时让出，否则立即返回
+template <typename Policy = DefaultPolicy>
+void maybe_yield();
+} // this_coroutine
+
+template <typename Policy = DefaultPolicy>
+BasicPollConfig<Policy>& getPollConfig();
+template <typename Policy = DefaultPolicy>
 void loop();
 
+// 让当前线程的loop()返回
+// grace期间照常运行，等待阻塞中的协程自行结束；正在co::accept4中等待的协程立即被取消
+// grace之后取消所有仍阻塞在co::接口中的协程（见Coroutine::cancel），
+// 等到它们都离开阻塞、就绪队列为空时loop()返回，之后可以再次调用loop()
+// Note: 被取消的接口返回-1（errno为ECANCELED），协程应当据此退出
+template <typename Policy = DefaultPolicy>
+void stop(std::chrono::milliseconds grace = {});
+
 
 
 
@@ -53,57 +139,525 @@ void loop();
 
 /// implement
 
-struct Event {
+// fd上关注的事件类型，与配置无关
+struct EventBase {
     enum Type {
         READ = 0,
         WRITE = 1,
         ERROR = 2,
         SIZE
     };
+};
+
+template <typename Policy>
+struct BasicEvent: EventBase {
+    // loop()不移除的关注，只唤醒wakers，见shareListener()
+    bool persistent {};
     // 0: POLLIN
     // 1: POLLOUT
     // 2: POLLERR
-    using RoutineTable = std::array<std::shared_ptr<Coroutine>, 3>;
+    using RoutineTable = std::array<std::shared_ptr<BasicCoroutine<Policy>>, 3>;
+    // 与routines一一对应，用于不依赖有栈协程的唤醒（见Task.h）
+    using WakerTable = std::array<Waker, 3>;
     RoutineTable routines;
+    WakerTable wakers;
     epoll_event event {};
 };
 
-struct PollConfig {
+// 写合并时fd的输出缓冲区
+template <typename Policy>
+struct BasicOutputBuffer {
+    std::vector<char>          data;
+    // 已写出的前缀长度
+    size_t                     offset {};
+    // 因缓冲区满而等待的协程
+    std::shared_ptr<BasicCoroutine<Policy>> writer;
+    // 后台flush遇到的错误，在下一次co::write / co::flush时返回
+    int                        error {};
+    // 已登记在PollConfig::dirty中
+    bool                       dirty {};
+    // 已关注EPOLLOUT
+    bool                       armed {};
+
+    size_t pending() const { return data.size() - offset; }
+};
+
+// 共享的listening fd上排队的acceptor，见shareListener()
+template <typename Policy>
+struct BasicAcceptQueue {
+    std::deque<std::shared_ptr<BasicCoroutine<Policy>>> waiters;
+};
+
+using OutputBuffer = BasicOutputBuffer<DefaultPolicy>;
+using AcceptQueue = BasicAcceptQueue<DefaultPolicy>;
+// accept的准入控制
+// loop()过载时co::accept4暂停接受新连接，期间不关注listening fd
+// 新连接留在内核backlog中，或者由SO_REUSEPORT的其它线程处理
+struct Admission {
+    using Milliseconds = std::chrono::milliseconds;
+    using Microseconds = std::chrono::microseconds;
+
+    constexpr static auto DEFAULT_PAUSE = std::chrono::milliseconds(10);
+
+    // 阈值，0表示不启用对应的判断
+    Microseconds maxLag {};
+    size_t       maxBacklog {};
+    // 过载时每次暂停的时长
+    Milliseconds pause {DEFAULT_PAUSE};
+
+    // 由loop()维护
+    // lag: 处理一批就绪事件的耗时（平滑后）
+    // backlog: 最近一次epoll_wait得到的就绪事件数
+    Microseconds lag {};
+    size_t       backlog {};
+
+    bool enabled() const { return maxLag.count() > 0 || maxBacklog > 0; }
+
+    bool overloaded() const {
+        return (maxLag.count() > 0 && lag > maxLag)
+            || (maxBacklog > 0 && backlog > maxBacklog);
+    }
+};
+
+
+// loop()使用的I/O后端，由Policy::Backend选择
+// 自定义后端可以继承它并替换其中的部分接口，比如换用epoll_pwait2或者加入统计
+struct EpollBackend {
+    static int create() { return ::epoll_create1(EPOLL_CLOEXEC); }
+
+    static int close(int epfd) { return ::close(epfd); }
+
+    static int control(int epfd, int op, int fd, epoll_event *event) {
+        return ::epoll_ctl(epfd, op, fd, event);
+    }
+
+    static int wait(int epfd, epoll_event *events, int maxEvents, int timeout) {
+        return ::epoll_wait(epfd, events, maxEvents, timeout);
+    }
+};
+
+// poll(2)后端，接口和语义与EpollBackend一致
+// 以一个eventfd作为句柄，关注的fd记录在线程局部的表中，每次wait都把整张表交给::poll
+// Note: EPOLLET按水平触发处理；代价随fd数目线性增长，只适用于fd很少的场合
+struct PollBackend {
+    struct Table {
+        std::vector<pollfd>       fds;
+        std::vector<epoll_data_t> data;
+    };
+
+    static std::unordered_map<int, Table>& tables() {
+        static thread_local std::unordered_map<int, Table> tables;
+        return tables;
+    }
+
+    static int create() {
+        int handle = ::eventfd(0, EFD_CLOEXEC);
+        if(handle >= 0) tables()[handle];
+        return handle;
+    }
+
+    static int close(int handle) {
+        tables().erase(handle);
+        return ::close(handle);
+    }
+
+    static int control(int handle, int op, int fd, epoll_event *event) {
+        auto iter = tables().find(handle);
+        if(iter == tables().end()) {
+            errno = EBADF;
+            return -1;
+        }
+        auto &table = iter->second;
+        auto where = std::find_if(table.fds.begin(), table.fds.end(),
+            [fd](const pollfd &p) { return p.fd == fd; });
+        size_t index = where - table.fds.begin();
+        bool exists = where != table.fds.end();
+        if(op == EPOLL_CTL_ADD && exists) {
+            errno = EEXIST;
+            return -1;
+        }
+        if(op != EPOLL_CTL_ADD && !exists) {
+            errno = ENOENT;
+            return -1;
+        }
+        switch(op) {
+            case EPOLL_CTL_ADD:
+                table.fds.push_back({fd, 0, 0});
+                table.data.emplace_back();
+                break;
+            case EPOLL_CTL_MOD:
+                break;
+            case EPOLL_CTL_DEL:
+                remove(table, index);
+                return 0;
+            default:
+                errno = EINVAL;
+                return -1;
+        }
+        // EPOLL*与POLL*的取值在Linux上相同
+        table.fds[index].events = event->events & (POLLIN | POLLOUT | POLLPRI | POLLRDHUP);
+        table.data[index] = event->data;
+        return 0;
+    }
+
+    static int wait(int handle, epoll_event *events, int maxEvents, int timeout) {
+        auto iter = tables().find(handle);
+        if(iter == tables().end()) {
+            errno = EBADF;
+            return -1;
+        }
+        auto &table = iter->second;
+        int ret = ::poll(table.fds.data(), table.fds.size(), timeout);
+        if(ret <= 0) return ret;
+        int n = 0;
+        for(size_t i = 0; i < table.fds.size() && n < maxEvents;) {
+            auto revents = table.fds[i].revents;
+            if(!revents) {
+                ++i;
+                continue;
+            }
+            events[n].data = table.data[i];
+            events[n].events = revents & ~POLLNVAL;
+            ++n;
+            // 已经关闭的fd，epoll会自动移除
+            if(revents & POLLNVAL) {
+                events[n - 1].events |= EPOLLERR | EPOLLHUP;
+                remove(table, i);
+                continue;
+            }
+            ++i;
+        }
+        return n;
+    }
+
+private:
+    static void remove(Table &table, size_t index) {
+        table.fds[index] = table.fds.back();
+        table.fds.pop_back();
+        table.data[index] = table.data.back();
+        table.data.pop_back();
+    }
+};
+
+// internal
+// 协程阻塞在co::接口期间的登记，位于该协程的栈上
+// 期间Coroutine::cancel()调用canceller撤销等待，stop()通过PollConfig::parked找到所有阻塞的协程
+// Note: canceller只能把协程放入就绪队列，不能直接resume
+template <typename Policy>
+class BasicParking {
+public:
+    using Coroutine = BasicCoroutine<Policy>;
+
+    explicit BasicParking(Waker canceller, bool accepting = false);
+    ~BasicParking();
+    BasicParking(const BasicParking&) = delete;
+    BasicParking& operator=(const BasicParking&) = delete;
+
+    Coroutine& coroutine() const { return *_coroutine; }
+    // 等待新连接，stop()时最先取消
+    bool accepting() const { return _accepting; }
+    BasicParking* next() const { return _next; }
+
+private:
+    Coroutine    *_coroutine;
+    bool         _accepting;
+    BasicParking *_prev {};
+    BasicParking *_next {};
+};
+
+using Parking = BasicParking<DefaultPolicy>;
+
+template <typename Policy>
+struct BasicPollConfig {
+    using Backend = typename Policy::Backend;
     // key: fd;
     // value: epoll_event
-    using EventList = std::unordered_map<int, Event>;
+    using EventList = typename Policy::template EventTable<int, BasicEvent<Policy>>;
+    using OutputList = typename Policy::template EventTable<int, BasicOutputBuffer<Policy>>;
+    using AcceptList = typename Policy::template EventTable<int, BasicAcceptQueue<Policy>>;
     using Milliseconds = std::chrono::milliseconds;
+    using Microseconds = std::chrono::microseconds;
 
     constexpr static auto DEFAULT_TIMEOUT = std::chrono::milliseconds(1000);
     constexpr static auto DEFAULT_CONNECT_RETRIES = size_t(8);
+    constexpr static auto DEFAULT_COALESCE_THRESHOLD = size_t(1) << 16;
 
     int          epfd;
     Milliseconds timeout {DEFAULT_TIMEOUT};
+    // 忙轮询预算：最近一次有事件到来后的spin时间内，epoll_wait不阻塞
+    // 超出预算才退回到以timeout阻塞，0表示不使用忙轮询
+    Microseconds spin {};
     EventList    events;
     size_t       connectRetries {DEFAULT_CONNECT_RETRIES};
-
-    explicit PollConfig(int fd = -1): epfd(fd) {
+    BufferPool   buffers;
+    // 写合并
+    OutputList       outputs;
+    std::vector<int> dirty;
+    size_t           coalesceThreshold {DEFAULT_COALESCE_THRESHOLD};
+    Admission        admission;
+    AcceptList       acceptors;
+    // 就绪队列，loop()在下一轮resume这些协程，非空时epoll_wait不阻塞
+    std::vector<std::shared_ptr<BasicCoroutine<Policy>>> ready;
+    // 阻塞在co::接口中的协程，侵入式链表
+    BasicParking<Policy> *parked {};
+    // co::stop()
+    bool                                  stopping {};
+    bool                                  draining {};
+    std::chrono::steady_clock::time_point stopDeadline {};
+
+    explicit BasicPollConfig(int fd = -1): epfd(fd) {
         if(epfd < 0) {
-            epfd = ::epoll_create1(EPOLL_CLOEXEC);
+            epfd = Backend::create();
         }
         if(epfd < 0) {
             throw std::runtime_error("poll config");
         }
     }
-    ~PollConfig() { ::close(epfd); }
-    PollConfig(const PollConfig&) = delete;
-    PollConfig& operator=(const PollConfig&) = delete;
+    ~BasicPollConfig() {
+        Backend::close(epfd);
+        if(threadBlock<Policy>().poll == this) {
+            threadBlock<Policy>().poll = nullptr;
+        }
+    }
+    BasicPollConfig(const BasicPollConfig&) = delete;
+    BasicPollConfig& operator=(const BasicPollConfig&) = delete;
 };
 
-inline PollConfig& getPollConfig() {
-    static thread_local PollConfig config;
+template <typename Policy>
+inline BasicPollConfig<Policy>& getPollConfig() {
+    auto &block = threadBlock<Policy>();
+    if(block.poll) {
+        return *block.poll;
+    }
+    static thread_local BasicPollConfig<Policy> config;
+    block.poll = &config;
     return config;
 }
 
+template <typename Policy>
+inline BasicParking<Policy>::BasicParking(Waker canceller, bool accepting)
+    : _coroutine(&Coroutine::current()),
+      _accepting(accepting) {
+    auto &config = getPollConfig<Policy>();
+    _coroutine->onCancel(canceller);
+    _next = config.parked;
+    if(_next) _next->_prev = this;
+    config.parked = this;
+}
+
+template <typename Policy>
+inline BasicParking<Policy>::~BasicParking() {
+    _coroutine->onCancel({});
+    if(_prev) {
+        _prev->_next = _next;
+    } else {
+        getPollConfig<Policy>().parked = _next;
+    }
+    if(_next) _next->_prev = _prev;
+}
+
+// 抢占使用的信号，默认忽略且很少被使用
+constexpr static int PREEMPT_SIGNAL = SIGURG;
+
 // internal
-inline auto addEvent(int fd, Event::Type type)
--> PollConfig::EventList::iterator {
-    auto &config = getPollConfig();
+// 每个线程的抢占状态，会在信号处理函数中访问，因此只能是POD
+struct PreemptState {
+    // 指向Environment的切换计数，nullptr表示未开启
+    const Counter *switches;
+    // 上一次定时器到期时的切换计数
+    uint64_t lastSwitches;
+    // 时间片用完，以及当时的切换计数
+    volatile sig_atomic_t expired;
+    uint64_t expiredAt;
+    bool hard;
+    // 在信号处理函数中让出当前协程，由preempt()按配置填入
+    void (*interrupt)(PreemptState&, uint64_t);
+    timer_t timer;
+};
+
+inline PreemptState& getPreemptState() {
+    static thread_local PreemptState state;
+    return state;
+}
+
+// 强制抢占的作用域，只用于纯计算的代码
+// 作用域内不允许持有锁、分配内存或者调用其它非异步信号安全的函数，
+// 否则同一线程上的其它协程可能因此死锁
+// 嵌套深度记录在当前协程上：作用域内被切走以后，同一线程上的其它协程不受影响
+template <typename Policy = DefaultPolicy>
+class BasicPreemptible {
+public:
+    BasicPreemptible(): _coroutine(BasicCoroutine<Policy>::current()) {
+        auto &depth = _coroutine.preemptible();
+        depth = depth + 1;
+    }
+    ~BasicPreemptible() {
+        auto &depth = _coroutine.preemptible();
+        depth = depth - 1;
+    }
+    BasicPreemptible(const BasicPreemptible&) = delete;
+    BasicPreemptible& operator=(const BasicPreemptible&) = delete;
+
+private:
+    BasicCoroutine<Policy> &_coroutine;
+};
+
+using Preemptible = BasicPreemptible<DefaultPolicy>;
+
+// internal
+// 当前协程排到就绪队列末尾并让出，主协程中什么都不做
+template <typename Policy = DefaultPolicy>
+inline bool reschedule() {
+    using Coroutine = BasicCoroutine<Policy>;
+    if(!Coroutine::test()) return false;
+    getPollConfig<Policy>().ready.emplace_back(Coroutine::current().shared_from_this());
+    Coroutine::yield();
+    return true;
+}
+
+// internal
+// 时间片在这次切换以前用完才算数，避免下一个协程替它让出
+inline bool expired(const PreemptState &state) {
+    return state.expired && state.switches
+        && state.expiredAt == state.switches->get();
+}
+
+// internal
+// 安全点，快速路径只有一次TLS读取
+template <typename Policy = DefaultPolicy>
+inline void checkpoint() {
+    auto &state = getPreemptState();
+    if(!state.expired) return;
+    bool yielding = expired(state);
+    state.expired = 0;
+    if(yielding) reschedule<Policy>();
+}
+
+template <typename Policy>
+inline void this_coroutine::maybe_yield() {
+    checkpoint<Policy>();
+}
+
+// internal
+// 在信号处理函数中让出，见PreemptState::interrupt
+template <typename Policy>
+inline void interrupt(PreemptState &state, uint64_t switches) {
+    using Coroutine = BasicCoroutine<Policy>;
+    // 只切走正位于Preemptible作用域内的协程
+    if(!Coroutine::test() || Coroutine::current().preemptible() <= 0) return;
+    // 就绪队列不能在这里扩容
+    auto &ready = getPollConfig<Policy>().ready;
+    if(ready.size() == ready.capacity()) return;
+    int savedErrno = errno;
+    state.expired = 0;
+    // 切走以后本线程不再位于信号处理函数中，需要先解除屏蔽
+    // 期间再次到期的信号不会重复抢占：lastSwitches已经不同
+    state.lastSwitches = ~switches;
+    sigset_t set;
+    ::sigemptyset(&set);
+    ::sigaddset(&set, PREEMPT_SIGNAL);
+    ::pthread_sigmask(SIG_UNBLOCK, &set, nullptr);
+    reschedule<Policy>();
+    errno = savedErrno;
+}
+
+// internal
+inline void onPreemptSignal(int) {
+    auto &state = getPreemptState();
+    if(!state.switches) return;
+    auto switches = state.switches->get();
+    // 两次到期之间发生过切换，重新开始计时
+    if(switches != state.lastSwitches) {
+        state.lastSwitches = switches;
+        return;
+    }
+    state.expiredAt = switches;
+    state.expired = 1;
+    if(!state.hard) return;
+    state.interrupt(state, switches);
+}
+
+// internal
+// 抢占依赖切换计数判断时间片是否用完，关闭统计时没有计数
+inline const Counter* switchCounter(const BasicStatistics<true> &statistics) {
+    return &statistics.switches;
+}
+
+inline const Counter* switchCounter(const BasicStatistics<false>&) {
+    return nullptr;
+}
+
+template <typename Policy>
+inline int preempt(std::chrono::microseconds budget, bool hard) {
+    constexpr static size_t READY_RESERVED = 64;
+    auto switches = switchCounter(BasicEnvironment<Policy>::instance().statistics());
+    if(!switches) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    static const bool installed = [] {
+        struct sigaction action {};
+        action.sa_handler = onPreemptSignal;
+        action.sa_flags = SA_RESTART;
+        ::sigemptyset(&action.sa_mask);
+        return ::sigaction(PREEMPT_SIGNAL, &action, nullptr) == 0;
+    }();
+    if(!installed) return -1;
+
+    auto &state = getPreemptState();
+    if(state.switches) {
+        ::timer_delete(state.timer);
+        state.switches = nullptr;
+        state.expired = 0;
+    }
+    if(budget.count() <= 0) return 0;
+
+    sigevent event {};
+    event.sigev_notify = SIGEV_THREAD_ID;
+    event.sigev_signo = PREEMPT_SIGNAL;
+    event.sigev_notify_thread_id = ::syscall(SYS_gettid);
+    // 线程CPU时间：阻塞在epoll_wait时不计时，也就不会被无谓地唤醒
+    if(::timer_create(CLOCK_THREAD_CPUTIME_ID, &event, &state.timer)) return -1;
+    itimerspec interval {};
+    interval.it_value.tv_sec = budget.count() / 1000000;
+    interval.it_value.tv_nsec = budget.count() % 1000000 * 1000;
+    interval.it_interval = interval.it_value;
+    auto &ready = getPollConfig<Policy>().ready;
+    ready.reserve(std::max(ready.capacity(), READY_RESERVED));
+    state.hard = hard;
+    state.interrupt = interrupt<Policy>;
+    state.lastSwitches = switches->get();
+    state.switches = switches;
+    if(::timer_settime(state.timer, 0, &interval, nullptr)) {
+        ::timer_delete(state.timer);
+        state.switches = nullptr;
+        return -1;
+    }
+    return 0;
+}
+
+// internal
+inline uint32_t eventMask(Event::Type type) {
+    switch(type) {
+        case Event::READ:
+            return EPOLLIN;
+        case Event::WRITE:
+            return EPOLLOUT;
+        case Event::ERROR:
+            return EPOLLERR;
+        default:
+            return 0;
+    };
+}
+
+// internal
+// 关注fd上的type事件，事件到来时由loop唤醒coroutine或者waker（二选一）
+// 如果已经存在相同的关注事件，返回events.end()
+template <typename Policy = DefaultPolicy>
+inline auto addEvent(int fd, Event::Type type,
+        std::shared_ptr<BasicCoroutine<Policy>> coroutine, Waker waker)
+-> typename BasicPollConfig<Policy>::EventList::iterator {
+    auto &config = getPollConfig<Policy>();
     auto &events = config.events;
     int epfd = config.epfd;
     auto iter = events.find(fd);
@@ -115,79 +669,374 @@ inline auto addEvent(int fd, Event::Type type)
         newAdd = true;
         iter = where.first;
         iter->second.event.data.fd = fd;
-        auto &slot = iter->second.routines[type];
-        slot = Coroutine::current().shared_from_this();
     } else {
         // impossible?
         op = EPOLL_CTL_MOD;
     }
     epoll_event *e = &iter->second.event;
-    int newEvent = 0;
-    switch(type) {
-        case Event::READ:
-            newEvent = EPOLLIN;
-            break;
-        case Event::WRITE:
-            newEvent = EPOLLOUT;
-            break;
-        case Event::ERROR:
-            newEvent = EPOLLERR;
-            break;
-    };
+    uint32_t newEvent = eventMask(type);
+    auto &statistics = BasicEnvironment<Policy>::instance().statistics();
     // duplicate ?
     if(e->events & newEvent) {
         // revert
         if(newAdd) {
             events.erase(fd);
         }
+        ++statistics.duplicates;
         return events.end();
     }
+    if(Policy::TRACING) {
+        BasicEnvironment<Policy>::instance().trace().record(Trace::REGISTER, coroutine.get(), nullptr, fd, type);
+    }
+    iter->second.routines[type] = std::move(coroutine);
+    iter->second.wakers[type] = waker;
     e->events |= newEvent;
-    if(::epoll_ctl(epfd, op, fd, e)) {
+    ++statistics.controls;
+    if(Policy::Backend::control(epfd, op, fd, e)) {
         // std::cerr << "ctl failed: " << strerror(errno) << std::endl;
     }
     return iter;
 }
 
+// internal
+template <typename Policy = DefaultPolicy>
+inline auto addEvent(int fd, Event::Type type)
+-> typename BasicPollConfig<Policy>::EventList::iterator {
+    return addEvent<Policy>(fd, type, BasicCoroutine<Policy>::current().shared_from_this(), {});
+}
+
+// internal
+template <typename Policy = DefaultPolicy>
+inline auto addEvent(int fd, Event::Type type, Waker waker)
+-> typename BasicPollConfig<Policy>::EventList::iterator {
+    return addEvent<Policy>(fd, type, nullptr, waker);
+}
+
+// internal
+// 撤销尚未到来的关注事件，其它方向的关注不受影响
+template <typename Policy = DefaultPolicy>
+inline void removeEvent(int fd, Event::Type type) {
+    auto &config = getPollConfig<Policy>();
+    auto iter = config.events.find(fd);
+    if(iter == config.events.end()) return;
+    auto &event = iter->second;
+    event.routines[type] = nullptr;
+    event.wakers[type] = {};
+    event.event.events &= ~eventMask(type);
+    ++BasicEnvironment<Policy>::instance().statistics().controls;
+    if(event.event.events) {
+        Policy::Backend::control(config.epfd, EPOLL_CTL_MOD, fd, &event.event);
+    } else {
+        Policy::Backend::control(config.epfd, EPOLL_CTL_DEL, fd, nullptr);
+        config.events.erase(iter);
+    }
+}
+
+// internal
+// 撤销coroutine在fd上尚未到来的关注，返回登记时持有的协程
+template <typename Policy = DefaultPolicy>
+inline std::shared_ptr<BasicCoroutine<Policy>> withdrawEvent(int fd, Event::Type type, BasicCoroutine<Policy> *coroutine) {
+    auto &events = getPollConfig<Policy>().events;
+    auto iter = events.find(fd);
+    if(iter == events.end() || iter->second.routines[type].get() != coroutine) {
+        return nullptr;
+    }
+    auto routine = std::move(iter->second.routines[type]);
+    removeEvent<Policy>(fd, type);
+    return routine;
+}
+
+// internal
+template <typename Policy>
+struct EventWait {
+    BasicCoroutine<Policy>   *coroutine;
+    int         fd;
+    Event::Type type;
+
+    // Parking的canceller
+    static void cancel(void *argument) {
+        auto &wait = *static_cast<EventWait*>(argument);
+        if(auto routine = withdrawEvent<Policy>(wait.fd, wait.type, wait.coroutine)) {
+            getPollConfig<Policy>().ready.emplace_back(std::move(routine));
+        }
+    }
+};
+
+// internal
+// 当前协程关注fd上的type事件并让出，直到loop()唤醒或者被取消
+// 返回-1表示已经存在相同的关注事件（errno为EEXIST），或者已被取消（errno为ECANCELED）
+template <typename Policy = DefaultPolicy>
+inline int park(int fd, Event::Type type, bool accepting = false) {
+    auto &coroutine = BasicCoroutine<Policy>::current();
+    if(coroutine.cancelled()) {
+        errno = ECANCELED;
+        return -1;
+    }
+    auto &poll = getPollConfig<Policy>();
+    if(addEvent<Policy>(fd, type) == poll.events.end()) {
+        errno = EEXIST;
+        return -1;
+    }
+    EventWait<Policy> wait {&coroutine, fd, type};
+    {
+        BasicParking<Policy> parking {{EventWait<Policy>::cancel, &wait}, accepting};
+        BasicCoroutine<Policy>::yield();
+    }
+    if(coroutine.cancelled()) {
+        // 由其它途径唤醒时关注仍然存在
+        withdrawEvent<Policy>(fd, type, &coroutine);
+        errno = ECANCELED;
+        return -1;
+    }
+    return 0;
+}
+
+template <typename Policy>
 inline ssize_t read(int fd, void *buf, size_t size) {
+    checkpoint<Policy>();
     // try
     ssize_t ret = ::read(fd, buf, size);
     // if ready
     if(ret > 0) return ret;
 
-    auto &poll = getPollConfig();
-    auto iter = addEvent(fd, Event::Type::READ);
-
     // 存在重复的关注事件
     // 返回0建议上层重试处理
     // FIXME. -1更好点？
-    if(iter == poll.events.end()) {
-        return 0;
+    if(park<Policy>(fd, Event::Type::READ)) {
+        return errno == EEXIST ? 0 : -1;
     }
 
-    this_coroutine::yield();
-
     // yield back from loop
     ret = ::read(fd, buf, size);
     return ret;
 }
 
+template <typename Policy>
+inline ssize_t readPooled(int fd, Buffer &buffer) {
+    checkpoint<Policy>();
+    auto &poll = getPollConfig<Policy>();
+    auto tryRead = [&] {
+        buffer = poll.buffers.acquire();
+        ssize_t ret = ::read(fd, buffer.data(), buffer.capacity());
+        if(ret > 0) {
+            buffer.resize(ret);
+        } else {
+            // 等待期间不持有缓冲区
+            buffer.release();
+        }
+        return ret;
+    };
+
+    ssize_t ret = tryRead();
+    if(ret > 0) return ret;
+    // EOF或者真正的错误不需要等待
+    if(ret == 0 || errno != EAGAIN) return ret;
+
+    if(park<Policy>(fd, Event::Type::READ)) {
+        return errno == EEXIST ? 0 : -1;
+    }
+
+    return tryRead();
+}
+
+// internal
+// 尽可能写出待发送数据，直到EAGAIN或者出错
+template <typename Policy>
+inline void flushOutput(int fd, BasicOutputBuffer<Policy> &output) {
+    auto &flushes = BasicEnvironment<Policy>::instance().statistics().flushes;
+    while(output.pending() && !output.error) {
+        ++flushes;
+        ssize_t n = ::write(fd, output.data.data() + output.offset, output.pending());
+        if(n > 0) {
+            output.offset += n;
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0 && errno == EAGAIN) {
+            break;
+        } else {
+            output.error = n < 0 ? errno : EPIPE;
+        }
+    }
+    if(!output.pending()) {
+        output.data.clear();
+        output.offset = 0;
+    }
+}
+
+// internal
+template <typename Policy>
+inline void armOutput(int fd, BasicOutputBuffer<Policy> &output);
+
+// internal
+// EPOLLOUT到来，继续写出并唤醒等待中的写者
+template <typename Policy>
+inline void onOutputWritable(void *argument) {
+    int fd = static_cast<int>(reinterpret_cast<intptr_t>(argument));
+    auto &outputs = getPollConfig<Policy>().outputs;
+    auto iter = outputs.find(fd);
+    if(iter == outputs.end()) return;
+    auto &output = iter->second;
+    output.armed = false;
+    flushOutput(fd, output);
+    if(output.pending() && !output.error) {
+        armOutput(fd, output);
+    }
+    if(output.writer) {
+        std::exchange(output.writer, nullptr)->resume();
+    }
+}
+
+// internal
+// 等待输出缓冲区的写者被取消
+template <typename Policy>
+inline void onOutputCancel(void *argument) {
+    int fd = static_cast<int>(reinterpret_cast<intptr_t>(argument));
+    auto &config = getPollConfig<Policy>();
+    auto iter = config.outputs.find(fd);
+    if(iter == config.outputs.end() || !iter->second.writer) return;
+    config.ready.emplace_back(std::move(iter->second.writer));
+}
+
+template <typename Policy>
+inline void armOutput(int fd, BasicOutputBuffer<Policy> &output) {
+    if(output.armed) return;
+    auto argument = reinterpret_cast<void*>(static_cast<intptr_t>(fd));
+    auto &poll = getPollConfig<Policy>();
+    auto iter = addEvent<Policy>(fd, Event::Type::WRITE, Waker{onOutputWritable<Policy>, argument});
+    output.armed = (iter != poll.events.end());
+}
+
+// internal
+// 等待输出缓冲区降至limit以下
+// 返回-1表示出错，此时errno为flush遇到的错误
+template <typename Policy>
+inline int drainOutput(int fd, size_t limit) {
+    auto &outputs = getPollConfig<Policy>().outputs;
+    for(;;) {
+        auto iter = outputs.find(fd);
+        if(iter == outputs.end()) return 0;
+        auto &output = iter->second;
+        flushOutput(fd, output);
+        if(output.error) {
+            errno = output.error;
+            return -1;
+        }
+        if(output.pending() <= limit) return 0;
+        auto &coroutine = BasicCoroutine<Policy>::current();
+        if(coroutine.cancelled()) {
+            errno = ECANCELED;
+            return -1;
+        }
+        armOutput(fd, output);
+        // 只允许一个写者等待
+        if(!output.armed || output.writer) {
+            errno = EBUSY;
+            return -1;
+        }
+        output.writer = coroutine.shared_from_this();
+        BasicParking<Policy> parking {{onOutputCancel<Policy>, reinterpret_cast<void*>(static_cast<intptr_t>(fd))}};
+        BasicCoroutine<Policy>::yield();
+    }
+}
+
+// internal
+// loop()在处理完一批就绪事件后调用
+template <typename Policy>
+inline void flushOutputs() {
+    auto &config = getPollConfig<Policy>();
+    if(config.dirty.empty()) return;
+    auto dirty = std::move(config.dirty);
+    config.dirty.clear();
+    for(int fd : dirty) {
+        auto iter = config.outputs.find(fd);
+        if(iter == config.outputs.end()) continue;
+        auto &output = iter->second;
+        output.dirty = false;
+        flushOutput(fd, output);
+        if(output.pending() && !output.error) {
+            armOutput(fd, output);
+        }
+    }
+}
+
+// internal
+template <typename Policy>
+inline ssize_t writeCoalesced(int fd, BasicOutputBuffer<Policy> &output, void *buf, size_t size) {
+    if(output.error) {
+        errno = output.error;
+        return -1;
+    }
+    auto &config = getPollConfig<Policy>();
+    if(output.offset) {
+        output.data.erase(output.data.begin(), output.data.begin() + output.offset);
+        output.offset = 0;
+    }
+    auto first = static_cast<const char*>(buf);
+    output.data.insert(output.data.end(), first, first + size);
+    if(!output.dirty) {
+        output.dirty = true;
+        config.dirty.emplace_back(fd);
+    }
+    // 超过阈值时立刻写出，写不出去就等待EPOLLOUT
+    if(output.pending() >= config.coalesceThreshold) {
+        if(drainOutput<Policy>(fd, config.coalesceThreshold - 1)) {
+            return -1;
+        }
+    }
+    return size;
+}
+
+template <typename Policy>
+inline int coalesce(int fd, bool enable) {
+    auto &outputs = getPollConfig<Policy>().outputs;
+    if(enable) {
+        outputs[fd];
+        return 0;
+    }
+    int ret = flush<Policy>(fd);
+    auto iter = outputs.find(fd);
+    if(iter == outputs.end()) return ret;
+    // flush失败或者被取消时可能仍关注着EPOLLOUT，fd关闭后编号会被复用
+    if(iter->second.armed) {
+        auto &events = getPollConfig<Policy>().events;
+        auto event = events.find(fd);
+        if(event != events.end() && event->second.wakers[Event::WRITE].wake == onOutputWritable<Policy>) {
+            removeEvent<Policy>(fd, Event::WRITE);
+        }
+    }
+    outputs.erase(iter);
+    return ret;
+}
+
+template <typename Policy>
+inline int flush(int fd) {
+    return drainOutput<Policy>(fd, 0);
+}
+
+template <typename Policy>
 inline ssize_t write(int fd, void *buf, size_t size) {
+    checkpoint<Policy>();
+    auto &outputs = getPollConfig<Policy>().outputs;
+    if(!outputs.empty()) {
+        auto iter = outputs.find(fd);
+        if(iter != outputs.end()) {
+            return writeCoalesced(fd, iter->second, buf, size);
+        }
+    }
     ssize_t ret;
     ret = ::write(fd, buf, size);
     if(ret > 0) return ret;
-    auto &poll = getPollConfig();
-    auto iter = addEvent(fd, Event::Type::WRITE);
-    if(iter == poll.events.end()) {
-        return 0;
+    if(park<Policy>(fd, Event::Type::WRITE)) {
+        return errno == EEXIST ? 0 : -1;
     }
-    this_coroutine::yield();
     ret = ::write(fd, buf, size);
     return ret;
 }
 
+template <typename Policy>
 inline int connect(int fd, const sockaddr *addr, socklen_t len) {
-    const size_t maxRetries = getPollConfig().connectRetries;
+    checkpoint<Policy>();
+    const size_t maxRetries = getPollConfig<Policy>().connectRetries;
     size_t retries = 0;
 
     while(retries < maxRetries) {
@@ -196,22 +1045,18 @@ inline int connect(int fd, const sockaddr *addr, socklen_t len) {
         // 0 - 0 - 0 - 1s - 2s - 4s - 8s - 16s - 32s - ...
         // or custom retries
         if(retries++ > 2) {
-            co::poll(nullptr, 0, 1024 << (retries - 3));
+            co::poll<Policy>(nullptr, 0, 1024 << (retries - 3));
         }
 
         int ret;
 
         ret = ::connect(fd, addr, len);
 
-        auto &poll = getPollConfig();
-        auto iter = addEvent(fd, Event::Type::WRITE);
-        if(iter == poll.events.end()) {
-            errno = EPERM;
+        if(park<Policy>(fd, Event::Type::WRITE)) {
+            if(errno == EEXIST) errno = EPERM;
             return -1;
         }
 
-        this_coroutine::yield();
-
         int soerr;
         socklen_t jojo = sizeof(soerr);
         if(::getsockopt(fd, SOL_SOCKET, SO_ERROR, &soerr, &jojo)) {
@@ -250,19 +1095,279 @@ inline int connect(int fd, const sockaddr *addr, socklen_t len) {
     return -1;
 }
 
+// internal
+// 准入控制：过载时暂停accept，被取消时返回-1
+template <typename Policy>
+inline int admit() {
+    auto &admission = getPollConfig<Policy>().admission;
+    while(admission.overloaded()) {
+        if(co::poll<Policy>(nullptr, 0, admission.pause.count()) < 0) return -1;
+    }
+    return 0;
+}
+
+// internal
+// 唤醒共享listening fd上的下一个等待者
+template <typename Policy>
+inline void wakeAcceptor(int fd) {
+    auto &config = getPollConfig<Policy>();
+    auto iter = config.acceptors.find(fd);
+    if(iter == config.acceptors.end() || iter->second.waiters.empty()) return;
+    auto &waiters = iter->second.waiters;
+    config.ready.emplace_back(std::move(waiters.front()));
+    waiters.pop_front();
+}
+
+// internal
+// 常驻关注的waker：edge-triggered，每个边沿只唤醒一个等待者
+template <typename Policy>
+inline void onAcceptReady(void *argument) {
+    wakeAcceptor<Policy>(static_cast<int>(reinterpret_cast<intptr_t>(argument)));
+}
+
+// internal
+template <typename Policy>
+struct AcceptWait {
+    BasicCoroutine<Policy> *coroutine;
+    int       fd;
+
+    // Parking的canceller
+    static void cancel(void *argument) {
+        auto &wait = *static_cast<AcceptWait*>(argument);
+        auto &config = getPollConfig<Policy>();
+        auto iter = config.acceptors.find(wait.fd);
+        if(iter == config.acceptors.end()) return;
+        auto &waiters = iter->second.waiters;
+        for(auto w = waiters.begin(); w != waiters.end(); ++w) {
+            if(w->get() == wait.coroutine) {
+                config.ready.emplace_back(std::move(*w));
+                waiters.erase(w);
+                return;
+            }
+        }
+    }
+};
+
+// internal
+// 在共享的listening fd上排队等待
+// 返回-1表示已被取消（ECANCELED）或者共享已经关闭（EBADF）
+template <typename Policy>
+inline int parkAcceptor(int fd, BasicAcceptQueue<Policy> &queue) {
+    auto &coroutine = BasicCoroutine<Policy>::current();
+    if(coroutine.cancelled()) {
+        errno = ECANCELED;
+        return -1;
+    }
+    queue.waiters.emplace_back(coroutine.shared_from_this());
+    AcceptWait<Policy> wait {&coroutine, fd};
+    {
+        BasicParking<Policy> parking {{AcceptWait<Policy>::cancel, &wait}, true};
+        BasicCoroutine<Policy>::yield();
+    }
+    auto &acceptors = getPollConfig<Policy>().acceptors;
+    if(coroutine.cancelled()) {
+        // 可能已经被边沿唤醒，转交给下一个等待者
+        wakeAcceptor<Policy>(fd);
+        errno = ECANCELED;
+        return -1;
+    }
+    if(!acceptors.count(fd)) {
+        errno = EBADF;
+        return -1;
+    }
+    return 0;
+}
+
+// internal
+inline bool wouldBlock(int error) {
+    return error == EAGAIN || error == EWOULDBLOCK;
+}
+
+template <typename Policy>
 inline int accept4(int fd, sockaddr *addr, socklen_t *len, int flags) {
+    checkpoint<Policy>();
+    if(admit<Policy>()) return -1;
+    auto &poll = getPollConfig<Policy>();
     int ret = ::accept4(fd, addr, len, flags);
-    if(ret >= 0) return ret;
-    auto &poll = getPollConfig();
-    auto iter = addEvent(fd, Event::Type::READ);
-    // FIXME 这里只允许单个协程对同一fd进行accpet
-    if(iter == poll.events.end()) return 0;
-    this_coroutine::yield();
-    ret = ::accept4(fd, addr, len, flags);
+    if(ret >= 0 || !wouldBlock(errno)) return ret;
+    auto queue = poll.acceptors.find(fd);
+    if(queue == poll.acceptors.end()) {
+        // FIXME 这里只允许单个协程对同一fd进行accpet，多个协程见shareListener()
+        if(park<Policy>(fd, Event::Type::READ, true)) {
+            return errno == EEXIST ? 0 : -1;
+        }
+        // 等待期间可能已经过载
+        if(admit<Policy>()) return -1;
+        ret = ::accept4(fd, addr, len, flags);
+        return ret;
+    }
+    // 被唤醒的等待者可能被其它协程抢先，继续排队
+    for(;;) {
+        if(parkAcceptor(fd, queue->second)) return -1;
+        if(admit<Policy>()) return -1;
+        ret = ::accept4(fd, addr, len, flags);
+        if(ret >= 0) {
+            // backlog中可能还有连接
+            wakeAcceptor<Policy>(fd);
+            return ret;
+        }
+        if(!wouldBlock(errno)) return ret;
+        // rehash之后迭代器失效
+        queue = poll.acceptors.find(fd);
+        if(queue == poll.acceptors.end()) {
+            errno = EBADF;
+            return -1;
+        }
+    }
+}
+
+template <typename Policy>
+inline int acceptBatch(int fd, int *connections, size_t max, int flags) {
+    checkpoint<Policy>();
+    if(max == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if(admit<Policy>()) return -1;
+    auto &poll = getPollConfig<Policy>();
+    for(;;) {
+        size_t n = 0;
+        int error = 0;
+        while(n < max) {
+            int connection = ::accept4(fd, nullptr, nullptr, flags);
+            if(connection >= 0) {
+                connections[n++] = connection;
+                continue;
+            }
+            // 对方在accept之前就断开的连接直接跳过
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            error = errno;
+            break;
+        }
+        auto queue = poll.acceptors.find(fd);
+        bool shared = queue != poll.acceptors.end();
+        if(n > 0) {
+            // 接受满额，backlog中可能还有连接
+            if(shared && n == max) wakeAcceptor<Policy>(fd);
+            return n;
+        }
+        if(!wouldBlock(error)) {
+            errno = error;
+            return -1;
+        }
+        if(shared) {
+            if(parkAcceptor(fd, queue->second)) return -1;
+        } else if(park<Policy>(fd, Event::Type::READ, true)) {
+            return -1;
+        }
+        if(admit<Policy>()) return -1;
+    }
+}
+
+template <typename Policy>
+inline int shareListener(int fd, bool enable) {
+    auto &config = getPollConfig<Policy>();
+    auto iter = config.acceptors.find(fd);
+    if(enable) {
+        if(iter != config.acceptors.end()) return 0;
+        // 已经有协程以普通方式等待
+        if(config.events.count(fd)) {
+            errno = EEXIST;
+            return -1;
+        }
+        auto &event = config.events[fd];
+        event.persistent = true;
+        event.wakers[Event::READ] = {onAcceptReady<Policy>, reinterpret_cast<void*>(static_cast<intptr_t>(fd))};
+        event.event.events = EPOLLIN | EPOLLET;
+        event.event.data.fd = fd;
+        ++BasicEnvironment<Policy>::instance().statistics().controls;
+        if(Policy::Backend::control(config.epfd, EPOLL_CTL_ADD, fd, &event.event)) {
+            config.events.erase(fd);
+            return -1;
+        }
+        config.acceptors[fd];
+        return 0;
+    }
+    if(iter == config.acceptors.end()) return 0;
+    auto waiters = std::move(iter->second.waiters);
+    config.acceptors.erase(iter);
+    config.events.erase(fd);
+    ++BasicEnvironment<Policy>::instance().statistics().controls;
+    Policy::Backend::control(config.epfd, EPOLL_CTL_DEL, fd, nullptr);
+    for(auto &&waiter : waiters) {
+        config.ready.emplace_back(std::move(waiter));
+    }
+    return 0;
+}
+
+// 旧版本的头文件可能没有定义
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+template <typename Policy>
+inline int recvmmsg(int fd, mmsghdr *msgvec, unsigned int vlen, int flags) {
+    checkpoint<Policy>();
+    int ret = ::recvmmsg(fd, msgvec, vlen, flags, nullptr);
+    if(ret > 0) return ret;
+    if(ret < 0 && errno != EAGAIN) return ret;
+    if(park<Policy>(fd, Event::Type::READ)) {
+        return errno == EEXIST ? 0 : -1;
+    }
+    ret = ::recvmmsg(fd, msgvec, vlen, flags, nullptr);
     return ret;
 }
 
+template <typename Policy>
+inline int sendmmsg(int fd, mmsghdr *msgvec, unsigned int vlen, int flags) {
+    checkpoint<Policy>();
+    int ret = ::sendmmsg(fd, msgvec, vlen, flags);
+    if(ret > 0) return ret;
+    if(ret < 0 && errno != EAGAIN) return ret;
+    if(park<Policy>(fd, Event::Type::WRITE)) {
+        return errno == EEXIST ? 0 : -1;
+    }
+    ret = ::sendmmsg(fd, msgvec, vlen, flags);
+    return ret;
+}
+
+inline int setUdpSegment(int fd, int segmentSize) {
+    return ::setsockopt(fd, SOL_UDP, UDP_SEGMENT, &segmentSize,
+        static_cast<socklen_t>(sizeof segmentSize));
+}
+
+inline int setUdpGro(int fd, bool enable) {
+    int opt = enable;
+    return ::setsockopt(fd, SOL_UDP, UDP_GRO, &opt,
+        static_cast<socklen_t>(sizeof opt));
+}
+
+// 需要在msg_control中预留CMSG_SPACE(sizeof(int))
+// 返回-1表示该消息没有被合并
+inline int groSegmentSize(const msghdr &msg) {
+    auto *m = const_cast<msghdr*>(&msg);
+    for(auto cmsg = CMSG_FIRSTHDR(m); cmsg; cmsg = CMSG_NXTHDR(m, cmsg)) {
+        if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+            int size;
+            ::memcpy(&size, CMSG_DATA(cmsg), sizeof size);
+            return size;
+        }
+    }
+    return -1;
+}
+
+inline int setBusyPoll(int fd, std::chrono::microseconds budget) {
+    int usec = budget.count();
+    return ::setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec,
+        static_cast<socklen_t>(sizeof usec));
+}
+
+template <typename Policy>
 inline unsigned int sleep(unsigned int seconds) {
+    checkpoint<Policy>();
     using namespace std::chrono;
     auto now = [] { return steady_clock::now(); };
     auto delta = [&, start = now()] {
@@ -285,18 +1390,22 @@ inline unsigned int sleep(unsigned int seconds) {
         return delta();
     }
 
-    auto iter = addEvent(timerfd, Event::Type::READ);
-
-    co::this_coroutine::yield();
+    auto &timers = BasicEnvironment<Policy>::instance().statistics().timers;
+    ++timers;
+    int parked = park<Policy>(timerfd, Event::Type::READ);
+    --timers;
 
     itimerspec retValue {};
-    if(::timerfd_gettime(timerfd, &retValue)) {
+    // 被取消时与被信号中断一样返回剩余的秒数
+    if(parked || ::timerfd_gettime(timerfd, &retValue)) {
         return delta();
     }
     return retValue.it_value.tv_sec;
 }
 
+template <typename Policy>
 inline int usleep(useconds_t usec) {
+    checkpoint<Policy>();
     // usec is greater than or equal to 1000000.
     // (On systems where that is considered an error.)
     if(usec >= 1000000) {
@@ -322,9 +1431,13 @@ inline int usleep(useconds_t usec) {
         return -1;
     }
 
-    auto iter = addEvent(timerfd, Event::Type::READ);
-
-    co::this_coroutine::yield();
+    auto &timers = BasicEnvironment<Policy>::instance().statistics().timers;
+    ++timers;
+    int parked = park<Policy>(timerfd, Event::Type::READ);
+    --timers;
+    if(parked) {
+        return -1;
+    }
 
     itimerspec retValue {};
     if(::timerfd_gettime(timerfd, &retValue)) {
@@ -335,7 +1448,9 @@ inline int usleep(useconds_t usec) {
     return ret;
 }
 
+template <typename Policy>
 inline int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
+    checkpoint<Policy>();
 
     // TODO 如果有同一fd关注到不同的fds下标，需要poll merge
     // TODO 针对空fds、单个fds的场合其实仍有优化空间，有空再写吧
@@ -403,8 +1518,13 @@ inline int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
         return -1;
     }
 
-    addEvent(epfd, Event::Type::READ);
-    co::this_coroutine::yield();
+    auto &timers = BasicEnvironment<Policy>::instance().statistics().timers;
+    ++timers;
+    int parked = park<Policy>(epfd, Event::Type::READ);
+    --timers;
+    if(parked) {
+        return -1;
+    }
 
     // collect
 
@@ -439,23 +1559,120 @@ inline int poll(struct pollfd *fds, nfds_t nfds, int timeout) {
     return ret;
 }
 
+template <typename Policy>
+inline void stop(std::chrono::milliseconds grace) {
+    auto &config = getPollConfig<Policy>();
+    auto deadline = std::chrono::steady_clock::now() + grace;
+    // 多次调用时以最早的为准
+    if(!config.stopping || deadline < config.stopDeadline) {
+        config.stopDeadline = deadline;
+    }
+    config.stopping = true;
+}
+
+// internal
+// stop()之后由loop()在每一轮调用，返回true时loop()退出
+template <typename Policy>
+inline bool drain(BasicPollConfig<Policy> &config) {
+    bool expired = std::chrono::steady_clock::now() >= config.stopDeadline;
+    if(!config.draining || expired) {
+        // 不再接受新连接，grace之后不再等待
+        // canceller只会把协程放入就绪队列，遍历期间链表不变
+        for(auto parking = config.parked; parking; parking = parking->next()) {
+            if(expired || parking->accepting()) {
+                parking->coroutine().cancel();
+            }
+        }
+        config.draining = true;
+    }
+    if(config.parked || !config.ready.empty()) return false;
+    config.stopping = false;
+    config.draining = false;
+    return true;
+}
+
+template <typename Policy>
 inline void loop() {
-    auto &config = getPollConfig();
+    constexpr static int EVENTS_PER_POLL = 128;
+    constexpr static bool STATISTICS = Policy::STATISTICS;
+    constexpr static bool TRACING = Policy::TRACING;
+    using Clock = std::chrono::steady_clock;
+    using std::chrono::nanoseconds;
+    auto &config = getPollConfig<Policy>();
+    auto &statistics = BasicEnvironment<Policy>::instance().statistics();
+    auto &trace = BasicEnvironment<Policy>::instance().trace();
+    epoll_event revents[EVENTS_PER_POLL];
+    // 与config.ready交替使用，两者都保留容量
+    std::vector<std::shared_ptr<BasicCoroutine<Policy>>> ready;
+    // 最近一次有事件到来的时间，用于忙轮询
+    auto active = Clock::now();
+    // 上一次离开epoll_wait的时间，用于统计
+    auto awake = active;
     // config may change
     // don't get / cache fields outside loop
     for(;;) {
-        epoll_event e {};
+        // 上一批事件处理完毕，写出合并的输出
+        flushOutputs<Policy>();
+        if(config.stopping && drain(config)) return;
         auto &eventList = config.events;
-        int n = ::epoll_wait(config.epfd, &e, 1, config.timeout.count());
+        int timeout = config.timeout.count();
+        bool spinning = config.spin.count() > 0
+            && Clock::now() - active < config.spin;
+        if(spinning || !config.ready.empty()) timeout = 0;
+        if(config.stopping) {
+            // 按时醒来取消剩下的协程
+            using namespace std::chrono;
+            auto remain = duration_cast<milliseconds>(config.stopDeadline - Clock::now()).count() + 1;
+            remain = std::max<int64_t>(remain, 0);
+            if(timeout < 0 || timeout > remain) timeout = remain;
+        }
+        auto sleep = STATISTICS ? Clock::now() : awake;
+        int n = Policy::Backend::wait(config.epfd, revents, EVENTS_PER_POLL, timeout);
         // TODO 暂不处理errno
-        if(n == 1) {
-            int fd = e.data.fd;
+        // 只有统计、忙轮询和准入控制需要读取时间
+        bool timing = STATISTICS || config.spin.count() > 0 || config.admission.enabled();
+        auto wakeup = timing ? Clock::now() : awake;
+        ++statistics.polls;
+        statistics.events += std::max(n, 0);
+        if(TRACING) trace.record(Trace::POLL, nullptr, nullptr, n);
+        statistics.runningNanoseconds += nanoseconds(sleep - awake).count();
+        statistics.blockedNanoseconds += nanoseconds(wakeup - sleep).count();
+        awake = wakeup;
+        if(config.spin.count() > 0) {
+            if(n > 0) {
+                active = wakeup;
+            } else if(spinning) {
+                // 对超线程友好一些
+                __builtin_ia32_pause();
+            }
+        }
+        auto &admission = config.admission;
+        bool admitting = admission.enabled() && n > 0;
+        for(int i = 0; i < n; ++i) {
+            int fd = revents[i].data.fd;
             auto iter = eventList.find(fd);
             if(iter == eventList.end()) continue;
-            ::epoll_ctl(config.epfd, EPOLL_CTL_DEL, fd, nullptr);
+            if(iter->second.persistent) {
+                // waker可能关闭共享，先取出
+                auto wakers = iter->second.wakers;
+                for(auto &&waker : wakers) {
+                    if(waker) waker();
+                }
+                continue;
+            }
+            Policy::Backend::control(config.epfd, EPOLL_CTL_DEL, fd, nullptr);
+            ++statistics.controls;
             auto routines = std::move(iter->second.routines);
+            auto wakers = iter->second.wakers;
             auto revent = iter->second.event;
             eventList.erase(iter);
+            if(TRACING && trace.enabled()) {
+                for(int type = 0; type < Event::SIZE; ++type) {
+                    if(routines[type] || wakers[type]) {
+                        trace.record(Trace::WAKEUP, routines[type].get(), nullptr, fd, type);
+                    }
+                }
+            }
             // 为了简化处理
             // 即使已关注的**部分**revent没有到来，也同样进行resume
             // 因为可能存在跨协程操作同一个fd，不处理就会丢失
@@ -472,6 +1689,26 @@ inline void loop() {
             if(/* (revent.events & EPOLLERR) && */routines[Event::ERROR]) {
                 routines[Event::ERROR]->resume();
             }
+            for(auto &&waker : wakers) {
+                if(waker) waker();
+            }
+        }
+        // 让出的协程排在这一批事件之后，本轮新加入的留到下一轮
+        if(!config.ready.empty()) {
+            // 保证交换后的config.ready容量不变，见preempt()
+            ready.reserve(config.ready.capacity());
+            ready.swap(config.ready);
+            for(auto &&coroutine : ready) {
+                coroutine->resume();
+            }
+            ready.clear();
+        }
+        if(admitting) {
+            using namespace std::chrono;
+            auto elapsed = duration_cast<microseconds>(Clock::now() - wakeup);
+            // EWMA, alpha = 1/8
+            admission.lag += (elapsed - admission.lag) / 8;
+            admission.backlog = n;
         }
         // TODO 处理超时event
     }
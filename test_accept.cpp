@@ -0,0 +1,132 @@
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "co.hpp"
+
+// 连接风暴下的accept：客户端线程成批地建立连接再关闭，服务端只accept并关闭
+// - single: 单个协程co::accept4，每次唤醒一个连接
+// - batch: shareListener之后由多个协程co::acceptBatch，每次唤醒最多接受batch个
+// 输出每个连接平均的epoll_ctl次数以及每次唤醒接受的连接数
+//
+// usage: ./test_accept [mode] [connections] [acceptors] [batch]
+
+static uint16_t port = 2341;
+static std::string mode = "batch";
+static size_t connections = 20000;
+static size_t acceptors = 4;
+static size_t batch = 64;
+
+static size_t accepted;
+static size_t wakeups;
+
+int prepare() {
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, static_cast<socklen_t>(sizeof opt));
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
+    if(::bind(server, (const sockaddr*)&addr, sizeof addr) || ::listen(server, SOMAXCONN)) {
+        ::exit(-1);
+    }
+    return server;
+}
+
+void single(int server) {
+    while(accepted < connections) {
+        int connection = co::accept4(server, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        ++wakeups;
+        if(connection > 0) {
+            ::close(connection);
+            ++accepted;
+        }
+    }
+    co::stop();
+}
+
+void batched(int server) {
+    std::vector<int> fds(batch);
+    while(accepted < connections) {
+        int n = co::acceptBatch(server, fds.data(), fds.size(), SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(n < 0) break;
+        ++wakeups;
+        for(int i = 0; i < n; ++i) {
+            ::close(fds[i]);
+        }
+        accepted += n;
+    }
+    co::stop();
+}
+
+// 阻塞的客户端，每一批建立burst个连接后一起关闭
+void storm() {
+    constexpr size_t BURST = 256;
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    std::vector<int> fds;
+    for(size_t done = 0; done < connections;) {
+        for(size_t i = 0; i < BURST && done < connections; ++i, ++done) {
+            int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if(::connect(fd, (const sockaddr*)&addr, sizeof addr)) {
+                ::close(fd);
+                continue;
+            }
+            fds.emplace_back(fd);
+        }
+        for(int fd : fds) ::close(fd);
+        fds.clear();
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    if(argc > 1) mode = argv[1];
+    if(argc > 2) connections = ::atoi(argv[2]);
+    if(argc > 3) acceptors = std::max(1, ::atoi(argv[3]));
+    if(argc > 4) batch = std::max(1, ::atoi(argv[4]));
+    ::signal(SIGPIPE, SIG_IGN);
+
+    auto &env = co::open();
+    int server = prepare();
+    auto &statistics = env.statistics();
+    auto controls = statistics.controls.get();
+    if(mode == "single") {
+        env.createCoroutine(single, server)->resume();
+    } else if(mode == "batch") {
+        co::shareListener(server);
+        for(size_t i = 0; i < acceptors; ++i) {
+            env.createCoroutine(batched, server)->resume();
+        }
+    } else {
+        std::cerr << "mode?" << std::endl;
+        return -1;
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    std::thread client(storm);
+    co::loop();
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    client.join();
+    co::shareListener(server, false);
+    ::close(server);
+
+    controls = statistics.controls.get() - controls;
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "mode: " << mode << ", accepted: " << accepted
+              << ", " << accepted / elapsed << " conn/s" << std::endl;
+    std::cout << "epoll_ctl per connection: " << double(controls) / std::max<size_t>(accepted, 1)
+              << ", connections per wakeup: " << double(accepted) / std::max<size_t>(wakeups, 1)
+              << std::endl;
+}
@@ -0,0 +1,101 @@
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include "co.hpp"
+
+// 准入控制示例：PollConfig::admission
+// 一个协程每次醒来都计算5ms，loop()处理一批事件的耗时超过maxLag后，co::accept4暂停接受新连接
+// 期间到来的连接留在内核backlog中，负载恢复后才被接受
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+static uint16_t port = 2342;
+static int accepted = 0;
+static bool hogging = false;
+
+void burn(milliseconds duration) {
+    auto until = Clock::now() + duration;
+    while(Clock::now() < until);
+}
+
+int prepare() {
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, static_cast<socklen_t>(sizeof opt));
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    if(::bind(server, (const sockaddr*)&addr, sizeof addr) || ::listen(server, SOMAXCONN)) {
+        ::exit(-1);
+    }
+    return server;
+}
+
+void listener(int server) {
+    for(;;) {
+        int connection = co::accept4(server, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(connection < 0 && errno == ECANCELED) break;
+        if(connection < 0) continue;
+        ++accepted;
+        ::close(connection);
+    }
+    ::close(server);
+}
+
+// 阻塞的connect在loopback上由内核完成握手，不需要等待accept
+void connectSome(int n) {
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    for(int i = 0; i < n; ++i) {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        ::connect(fd, (const sockaddr*)&addr, sizeof addr);
+        ::close(fd);
+    }
+}
+
+void hog() {
+    while(hogging) {
+        co::usleep(1000);
+        burn(milliseconds(5));
+    }
+}
+
+int main() {
+    auto &env = co::open();
+    auto &admission = co::getPollConfig().admission;
+    admission.maxLag = milliseconds(1);
+
+    env.createCoroutine(listener, prepare())->resume();
+    env.createCoroutine([&] {
+        connectSome(3);
+        co::usleep(20000);
+        std::cout << "accepted: " << accepted << std::endl;
+
+        hogging = true;
+        env.createCoroutine(hog)->resume();
+        co::usleep(100000);
+        std::cout << "overloaded: " << admission.overloaded() << std::endl;
+        connectSome(3);
+        co::usleep(100000);
+        std::cout << "accepted while overloaded: " << accepted << std::endl;
+
+        hogging = false;
+        for(int i = 0; i < 10; ++i) co::usleep(100000);
+        std::cout << "overloaded: " << admission.overloaded() << std::endl;
+        std::cout << "accepted after recovery: " << accepted << std::endl;
+        co::stop();
+    })->resume();
+    co::loop();
+}
+
+// expected output:
+// accepted: 3
+// overloaded: 1
+// accepted while overloaded: 3
+// overloaded: 0
+// accepted after recovery: 6
@@ -0,0 +1,132 @@
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "co.hpp"
+
+// echo服务器的压测客户端，配合test_bench_server或者bench.sh使用
+// 每个session在一个连接上ping-pong：写出size字节，再读回size字节，记录往返延迟
+//
+// usage: ./test_bench_client [port] [threads] [sessions] [size] [seconds]
+// - sessions为所有线程的总数，平均分给各个线程
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    uint16_t port = 2533;
+    int threads = 2;
+    size_t sessions = 10;
+    size_t size = 4096;
+    int seconds = 5;
+};
+
+static Options options;
+static Clock::time_point deadline;
+
+// 汇总结果
+static std::mutex mutex;
+static co::Histogram latencies;
+static size_t failures;
+static std::atomic<int> finished {};
+
+// 同一线程上的session共享histogram和failures
+void session(co::Histogram &histogram, size_t &failures) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(options.port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    if(fd < 0 || co::connect(fd, (const sockaddr*)&addr, sizeof addr)) {
+        ::close(fd);
+        ++failures;
+        return;
+    }
+    int optval = true;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, static_cast<socklen_t>(sizeof optval));
+
+    std::vector<char> request(options.size, 'x');
+    std::vector<char> response(options.size);
+    while(Clock::now() < deadline) {
+        auto start = Clock::now();
+        for(size_t written = 0; written < request.size();) {
+            ssize_t n = co::write(fd, request.data() + written, request.size() - written);
+            if(n < 0 && errno != EAGAIN) goto closed;
+            if(n > 0) written += n;
+        }
+        for(size_t got = 0; got < response.size();) {
+            ssize_t n = co::read(fd, response.data() + got, response.size() - got);
+            if(n == 0 || (n < 0 && errno != EAGAIN)) goto closed;
+            if(n > 0) got += n;
+        }
+        histogram.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+    ::close(fd);
+    return;
+closed:
+    ++failures;
+    ::close(fd);
+}
+
+void run(size_t sessions) {
+    auto &env = co::open();
+    env.createCoroutine([sessions] {
+        co::Histogram histogram;
+        size_t failed = 0;
+        co::TaskGroup group;
+        for(size_t i = 0; i < sessions; ++i) {
+            group.spawn(session, std::ref(histogram), std::ref(failed));
+        }
+        group.wait_all();
+        std::lock_guard<std::mutex> _ {mutex};
+        latencies.merge(histogram);
+        failures += failed;
+        ++finished;
+    })->resume();
+    co::loop();
+}
+
+int main(int argc, const char *argv[]) {
+    if(argc > 1) options.port = ::atoi(argv[1]);
+    if(argc > 2) options.threads = ::atoi(argv[2]);
+    if(argc > 3) options.sessions = ::atoi(argv[3]);
+    if(argc > 4) options.size = ::atoi(argv[4]);
+    if(argc > 5) options.seconds = ::atoi(argv[5]);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    auto start = Clock::now();
+    deadline = start + std::chrono::seconds(options.seconds);
+    for(int t = 0; t < options.threads; ++t) {
+        size_t sessions = options.sessions / options.threads
+                        + (size_t(t) < options.sessions % options.threads);
+        std::thread(run, sessions).detach();
+    }
+    while(finished < options.threads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> _ {mutex};
+    auto bytes = latencies.total() * options.size;
+    auto us = [](uint64_t ns) { return ns / 1e3; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "threads: " << options.threads << ", sessions: " << options.sessions
+              << ", size: " << options.size << ", seconds: " << options.seconds << std::endl;
+    std::cout << "throughput: " << bytes / elapsed / (1 << 20) << " MiB/s, "
+              << "round trips: " << latencies.total() << std::endl;
+    std::cout << "latency(us): p50 " << us(latencies.percentile(0.5))
+              << ", p99 " << us(latencies.percentile(0.99))
+              << ", p999 " << us(latencies.percentile(0.999))
+              << ", max " << us(latencies.max()) << std::endl;
+    if(failures) {
+        std::cout << "failed sessions: " << failures << std::endl;
+    }
+    ::exit(0);
+}
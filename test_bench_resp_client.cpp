@@ -0,0 +1,215 @@
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "co.hpp"
+
+// RESP服务器的pipeline压测客户端，配合test_bench_resp_server使用
+// 每个连接一次写出pipeline个GET / SET请求，再读回同样数目的回复，记录这一批的往返延迟
+//
+// usage: ./test_bench_resp_client [port] [threads] [connections] [pipeline] [seconds] [sets] [keys] [value]
+// - connections为所有线程的总数
+// - sets: SET请求所占的百分比
+// - keys: key的取值范围
+// - value: SET的value长度
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    uint16_t port = 6380;
+    int threads = 2;
+    size_t connections = 50;
+    size_t pipeline = 16;
+    int seconds = 5;
+    int sets = 10;
+    size_t keys = 100000;
+    size_t value = 64;
+};
+
+static Options options;
+static Clock::time_point deadline;
+
+// 汇总结果
+static std::mutex mutex;
+static co::Histogram latencies;
+static uint64_t requests;
+static uint64_t hits;
+static size_t failures;
+static std::atomic<int> finished {};
+
+// 同一线程上的连接共享
+struct Counters {
+    co::Histogram latencies;
+    uint64_t requests {};
+    uint64_t hits {};
+    size_t failures {};
+};
+
+void appendCommand(std::string &out, std::initializer_list<const std::string*> arguments) {
+    out += '*';
+    out += std::to_string(arguments.size());
+    out += "\r\n";
+    for(auto argument : arguments) {
+        out += '$';
+        out += std::to_string(argument->size());
+        out += "\r\n";
+        out += *argument;
+        out += "\r\n";
+    }
+}
+
+// 从data[offset]开始跳过一个完整的回复，不完整时返回false
+// hit: 是否为非空的bulk string
+bool skipReply(const std::string &data, size_t &offset, bool &hit) {
+    if(offset >= data.size()) return false;
+    size_t end = data.find("\r\n", offset);
+    if(end == std::string::npos) return false;
+    char type = data[offset];
+    hit = false;
+    if(type == '$') {
+        long length = ::strtol(data.c_str() + offset + 1, nullptr, 10);
+        if(length < 0) {
+            offset = end + 2;
+            return true;
+        }
+        if(data.size() < end + 2 + length + 2) return false;
+        hit = true;
+        offset = end + 2 + length + 2;
+        return true;
+    }
+    // +OK / -ERR / :1
+    offset = end + 2;
+    return true;
+}
+
+void connection(Counters &counters, unsigned seed) {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(options.port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    if(fd < 0 || co::connect(fd, (const sockaddr*)&addr, sizeof addr)) {
+        ::close(fd);
+        ++counters.failures;
+        return;
+    }
+    int optval = true;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &optval, static_cast<socklen_t>(sizeof optval));
+
+    std::mt19937 random {seed};
+    std::uniform_int_distribution<size_t> keys {0, options.keys - 1};
+    std::uniform_int_distribution<int> percent {0, 99};
+    const std::string get = "GET";
+    const std::string set = "SET";
+    const std::string value(options.value, 'v');
+    std::string key;
+    std::string request;
+    std::string response;
+    char buf[1 << 14];
+    while(Clock::now() < deadline) {
+        request.clear();
+        for(size_t i = 0; i < options.pipeline; ++i) {
+            key = "key:" + std::to_string(keys(random));
+            if(percent(random) < options.sets) {
+                appendCommand(request, {&set, &key, &value});
+            } else {
+                appendCommand(request, {&get, &key});
+            }
+        }
+        auto start = Clock::now();
+        for(size_t written = 0; written < request.size();) {
+            ssize_t n = co::write(fd, &request[written], request.size() - written);
+            if(n < 0 && errno != EAGAIN) goto closed;
+            if(n > 0) written += n;
+        }
+        response.clear();
+        for(size_t replies = 0, offset = 0; replies < options.pipeline;) {
+            ssize_t n = co::read(fd, buf, sizeof buf);
+            if(n == 0 || (n < 0 && errno != EAGAIN)) goto closed;
+            if(n < 0) continue;
+            response.append(buf, n);
+            bool hit;
+            while(replies < options.pipeline && skipReply(response, offset, hit)) {
+                ++replies;
+                counters.hits += hit;
+            }
+        }
+        counters.latencies.record(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+        counters.requests += options.pipeline;
+    }
+    ::close(fd);
+    return;
+closed:
+    ++counters.failures;
+    ::close(fd);
+}
+
+void run(size_t connections, unsigned seed) {
+    auto &env = co::open();
+    env.createCoroutine([=] {
+        Counters counters;
+        co::TaskGroup group;
+        for(size_t i = 0; i < connections; ++i) {
+            group.spawn(connection, std::ref(counters), seed + i);
+        }
+        group.wait_all();
+        std::lock_guard<std::mutex> _ {mutex};
+        latencies.merge(counters.latencies);
+        requests += counters.requests;
+        hits += counters.hits;
+        failures += counters.failures;
+        ++finished;
+    })->resume();
+    co::loop();
+}
+
+int main(int argc, const char *argv[]) {
+    if(argc > 1) options.port = ::atoi(argv[1]);
+    if(argc > 2) options.threads = ::atoi(argv[2]);
+    if(argc > 3) options.connections = ::atoi(argv[3]);
+    if(argc > 4) options.pipeline = std::max(1, ::atoi(argv[4]));
+    if(argc > 5) options.seconds = ::atoi(argv[5]);
+    if(argc > 6) options.sets = ::atoi(argv[6]);
+    if(argc > 7) options.keys = std::max(1, ::atoi(argv[7]));
+    if(argc > 8) options.value = ::atoi(argv[8]);
+    ::signal(SIGPIPE, SIG_IGN);
+
+    auto start = Clock::now();
+    deadline = start + std::chrono::seconds(options.seconds);
+    for(int t = 0; t < options.threads; ++t) {
+        size_t connections = options.connections / options.threads
+                           + (size_t(t) < options.connections % options.threads);
+        std::thread(run, connections, unsigned(t) << 16).detach();
+    }
+    while(finished < options.threads) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::lock_guard<std::mutex> _ {mutex};
+    auto us = [](uint64_t ns) { return ns / 1e3; };
+    std::cout << std::fixed << std::setprecision(2);
+    std::cout << "threads: " << options.threads << ", connections: " << options.connections
+              << ", pipeline: " << options.pipeline << ", sets: " << options.sets << "%"
+              << ", seconds: " << options.seconds << std::endl;
+    std::cout << "requests: " << requests << ", " << requests / elapsed << " ops/s"
+              << ", get hits: " << hits << std::endl;
+    std::cout << "batch latency(us): p50 " << us(latencies.percentile(0.5))
+              << ", p99 " << us(latencies.percentile(0.99))
+              << ", p999 " << us(latencies.percentile(0.999))
+              << ", max " << us(latencies.max()) << std::endl;
+    if(failures) {
+        std::cout << "failed connections: " << failures << std::endl;
+    }
+    ::exit(0);
+}
@@ -0,0 +1,289 @@
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <array>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "co.hpp"
+
+// 支持部分RESP协议（PING / GET / SET）的内存key-value服务器
+// 相比echo，多了协议解析、大量的小块写以及pipeline，用于衡量loop、缓冲区和写路径的改动
+// 压测客户端见test_bench_resp_client.cpp，也可以直接使用redis-cli或者redis-benchmark
+//
+// usage: ./test_bench_resp_server [threads] [port] [mode]
+// - threads: 每个线程一个loop，通过SO_REUSEPORT分摊连接，默认为CPU核数
+// - mode:
+//   - batch: 解析完一批请求后用一次write写出所有回复（默认）
+//   - coalesce: 每个回复单独co::write，由写合并负责合并
+
+enum class Mode {
+    BATCH,
+    COALESCE,
+};
+
+static uint16_t port = 6380;
+static Mode mode = Mode::BATCH;
+
+// 分片的哈希表，所有线程共享
+class Store {
+public:
+    constexpr static size_t SHARDS = 64;
+
+    bool get(const std::string &key, std::string &value) {
+        auto &shard = pick(key);
+        std::lock_guard<std::mutex> _ {shard.mutex};
+        auto iter = shard.table.find(key);
+        if(iter == shard.table.end()) return false;
+        value = iter->second;
+        return true;
+    }
+
+    void set(std::string key, std::string value) {
+        auto &shard = pick(key);
+        std::lock_guard<std::mutex> _ {shard.mutex};
+        shard.table[std::move(key)] = std::move(value);
+    }
+
+private:
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<std::string, std::string> table;
+    };
+
+    Shard& pick(const std::string &key) {
+        return _shards[std::hash<std::string>{}(key) % SHARDS];
+    }
+
+private:
+    std::array<Shard, SHARDS> _shards;
+};
+
+static Store store;
+
+// RESP请求的解析
+// 同时支持multibulk（*N\r\n$len\r\n...）和inline（PING\r\n）两种格式
+class Parser {
+public:
+    enum Result {
+        COMPLETE,
+        INCOMPLETE,
+        ERROR,
+    };
+
+    // 从data[offset]开始解析一个请求，成功时offset移动到请求之后
+    Result parse(const std::string &data, size_t &offset, std::vector<std::string> &arguments);
+
+private:
+    static bool line(const std::string &data, size_t from, size_t &end);
+    static bool number(const std::string &data, size_t from, size_t end, long &value);
+};
+
+inline bool Parser::line(const std::string &data, size_t from, size_t &end) {
+    end = data.find("\r\n", from);
+    return end != std::string::npos;
+}
+
+inline bool Parser::number(const std::string &data, size_t from, size_t end, long &value) {
+    if(from >= end) return false;
+    bool negative = data[from] == '-';
+    value = 0;
+    for(size_t i = from + negative; i < end; ++i) {
+        if(data[i] < '0' || data[i] > '9') return false;
+        value = value * 10 + (data[i] - '0');
+    }
+    if(negative) value = -value;
+    return true;
+}
+
+inline Parser::Result Parser::parse(const std::string &data, size_t &offset,
+                                    std::vector<std::string> &arguments) {
+    arguments.clear();
+    size_t position = offset;
+    size_t end;
+    if(position >= data.size()) return INCOMPLETE;
+    if(data[position] != '*') {
+        // inline
+        if(!line(data, position, end)) return INCOMPLETE;
+        for(size_t i = position; i < end;) {
+            while(i < end && data[i] == ' ') ++i;
+            size_t j = i;
+            while(j < end && data[j] != ' ') ++j;
+            if(j > i) arguments.emplace_back(data, i, j - i);
+            i = j;
+        }
+        offset = end + 2;
+        return COMPLETE;
+    }
+    long count;
+    if(!line(data, position, end)) return INCOMPLETE;
+    if(!number(data, position + 1, end, count) || count < 0) return ERROR;
+    position = end + 2;
+    for(long n = 0; n < count; ++n) {
+        long length;
+        if(position >= data.size()) return INCOMPLETE;
+        if(data[position] != '$') return ERROR;
+        if(!line(data, position, end)) return INCOMPLETE;
+        if(!number(data, position + 1, end, length) || length < 0) return ERROR;
+        position = end + 2;
+        if(data.size() < position + length + 2) return INCOMPLETE;
+        arguments.emplace_back(data, position, length);
+        position += length + 2;
+    }
+    offset = position;
+    return COMPLETE;
+}
+
+// 执行一个命令，把回复追加到reply
+void execute(std::vector<std::string> &arguments, std::string &reply) {
+    auto bulk = [&](const std::string &value) {
+        reply += '$';
+        reply += std::to_string(value.size());
+        reply += "\r\n";
+        reply += value;
+        reply += "\r\n";
+    };
+    if(arguments.empty()) return;
+    auto &command = arguments[0];
+    for(auto &c : command) c = ::toupper(c);
+    if(command == "GET" && arguments.size() == 2) {
+        std::string value;
+        if(store.get(arguments[1], value)) {
+            bulk(value);
+        } else {
+            reply += "$-1\r\n";
+        }
+    } else if(command == "SET" && arguments.size() >= 3) {
+        store.set(std::move(arguments[1]), std::move(arguments[2]));
+        reply += "+OK\r\n";
+    } else if(command == "PING") {
+        if(arguments.size() > 1) {
+            bulk(arguments[1]);
+        } else {
+            reply += "+PONG\r\n";
+        }
+    } else {
+        reply += "-ERR unknown command '" + command + "'\r\n";
+    }
+}
+
+bool writeAll(int fd, const std::string &data) {
+    for(size_t written = 0; written < data.size();) {
+        ssize_t n = co::write(fd, (void*)(data.data() + written), data.size() - written);
+        if(n < 0 && errno != EAGAIN) return false;
+        if(n > 0) written += n;
+    }
+    return true;
+}
+
+void session(int connection) {
+    if(mode == Mode::COALESCE) {
+        co::coalesce(connection);
+    }
+    Parser parser;
+    std::string input;
+    std::string reply;
+    std::vector<std::string> arguments;
+    size_t offset = 0;
+    co::Buffer buf;
+    for(bool open = true; open;) {
+        ssize_t n = co::readPooled(connection, buf);
+        if(n == 0 || (n < 0 && errno != EAGAIN)) break;
+        if(n < 0) continue;
+        input.append(buf.data(), n);
+        // 解析出所有完整的请求，一次写出
+        for(;;) {
+            auto result = parser.parse(input, offset, arguments);
+            if(result == Parser::INCOMPLETE) break;
+            if(result == Parser::ERROR) {
+                reply += "-ERR protocol error\r\n";
+                open = false;
+                break;
+            }
+            execute(arguments, reply);
+            if(mode == Mode::COALESCE) {
+                if(!writeAll(connection, reply)) open = false;
+                reply.clear();
+            }
+        }
+        if(!reply.empty()) {
+            if(!writeAll(connection, reply)) open = false;
+            reply.clear();
+        }
+        // 剩下半个请求
+        input.erase(0, offset);
+        offset = 0;
+    }
+    if(mode == Mode::COALESCE) {
+        co::coalesce(connection, false);
+    }
+    ::close(connection);
+}
+
+int prepare() {
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(server < 0) {
+        ::exit(-1);
+    }
+    int opt = 1;
+    if(::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, static_cast<socklen_t>(sizeof opt))
+            || ::setsockopt(server, SOL_SOCKET, SO_REUSEPORT, &opt, static_cast<socklen_t>(sizeof opt))) {
+        ::exit(-2);
+    }
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
+    if(::bind(server, (const sockaddr*)&addr, sizeof addr)) {
+        ::exit(-3);
+    }
+    if(::listen(server, SOMAXCONN)) {
+        ::exit(-4);
+    }
+    return server;
+}
+
+void listener(int server) {
+    auto &env = co::open();
+    while(1) {
+        int connection = co::accept4(server, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(connection < 0) {
+            continue;
+        }
+        int optval = true;
+        ::setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &optval,
+                static_cast<socklen_t>(sizeof optval));
+        env.createCoroutine(session, connection)->resume();
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    int threads = argc > 1 ? ::atoi(argv[1]) : std::thread::hardware_concurrency();
+    if(argc > 2) port = ::atoi(argv[2]);
+    if(argc > 3) {
+        std::string name = argv[3];
+        if(name == "coalesce") mode = Mode::COALESCE;
+        else if(name != "batch") {
+            std::cerr << "mode?" << std::endl;
+            return -1;
+        }
+    }
+    ::signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::thread> loops;
+    for(int t = 0; t < std::max(threads, 1); ++t) {
+        loops.emplace_back([] {
+            auto &env = co::open();
+            int server = prepare();
+            env.createCoroutine(listener, server)->resume();
+            co::loop();
+        });
+    }
+    for(auto &&loop : loops) loop.join();
+}
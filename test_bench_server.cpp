@@ -6,19 +6,34 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <iostream>
+#include <string>
 #include <vector>
 #include <thread>
 #include "co.hpp"
 
-// script: https://github.com/Caturra000/FluentNet/blob/master/bench/fluent_throughput/bench.py
-// client: https://github.com/Caturra000/FluentNet/blob/master/bench/fluent_throughput/asio_client.cpp
+// echo服务器，压测客户端见test_bench_client.cpp，一键对比见bench.sh
+//
+// usage: ./test_bench_server threads [port] [mode]
+// - mode: 几种实现方式
+//   - pooled: 数据到来时才从BufferPool借出缓冲区（默认）
+//   - stack: 每个连接在协程栈上持有缓冲区
+//   - coalesce: 同pooled，并且开启写合并
 
+enum class Mode {
+    POOLED,
+    STACK,
+    COALESCE,
+};
 
+static uint16_t port = 2533;
+static Mode mode = Mode::POOLED;
 
 // return: server fd
 int prepare();
 
 void worker(int index, int connection);
+// mode为stack时的worker
+void stackWorker(int index, int connection);
 void listener(int server);
 
 
@@ -31,6 +46,16 @@ int main(int argc, const char *argv[]) {
 
     std::vector<std::thread> workers;
     int threads = ::atoi(argv[1]);
+    if(argc > 2) port = ::atoi(argv[2]);
+    if(argc > 3) {
+        std::string name = argv[3];
+        if(name == "stack") mode = Mode::STACK;
+        else if(name == "coalesce") mode = Mode::COALESCE;
+        else if(name != "pooled") {
+            std::cerr << "mode?" << std::endl;
+            return -1;
+        }
+    }
 
     for(auto t = 0; t < threads; ++t) {
         workers.emplace_back([=] {
@@ -66,7 +91,7 @@ int prepare() {
     sockaddr_in addr;
     ::memset(&addr, 0, sizeof addr);
     addr.sin_family = AF_INET;
-    addr.sin_port = ::htons(2533);
+    addr.sin_port = ::htons(port);
     addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
     if(::bind(server, (const sockaddr*)&addr, sizeof addr)) {
         ::exit(-4);
@@ -77,21 +102,49 @@ int prepare() {
     return server;
 }
 
+// 写出data中的n个字节
+void echo(int connection, char *data, int n) {
+    int lea = n;
+    int start = 0;
+    while(lea > 0) {
+        int consume = co::write(connection, data + start, lea);
+        if(consume > 0) {
+            lea -= consume;
+            start += consume;
+        }
+    }
+}
+
 void worker(int index, int connection) {
     // read-write echo
-    char buf[65538];
+    // 缓冲区只在数据到来时借出，空闲连接不占用
+    co::Buffer buf;
+    if(mode == Mode::COALESCE) {
+        co::coalesce(connection);
+    }
     while(1) {
-        int n = co::read(connection, buf, sizeof buf);
-
-        int lea = n;
-        int start = 0;
-        while(lea > 0) {
-            int consume = co::write(connection, buf + start, lea);
-            if(consume > 0) {
-                lea -= consume;
-                start += consume;
+        int n = co::readPooled(connection, buf);
+        if(n == 0 || (n < 0 && errno != EAGAIN)) {
+            if(mode == Mode::COALESCE) {
+                co::coalesce(connection, false);
             }
+            ::close(connection);
+            return;
+        }
+        echo(connection, buf.data(), n);
+    }
+}
+
+void stackWorker(int index, int connection) {
+    // 缓冲区位于协程栈上，空闲连接同样占用
+    char buf[co::BufferPool::DEFAULT_BUFFER_SIZE];
+    while(1) {
+        int n = co::read(connection, buf, sizeof buf);
+        if(n == 0 || (n < 0 && errno != EAGAIN)) {
+            ::close(connection);
+            return;
         }
+        echo(connection, buf, n);
     }
 }
 
@@ -109,7 +162,7 @@ void listener(int server) {
         int optval = true;
         ::setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &optval,
                 static_cast<socklen_t>(sizeof optval));
-        auto co = env.createCoroutine(worker, index++, connection);
+        auto co = env.createCoroutine(mode == Mode::STACK ? stackWorker : worker, index++, connection);
         co->resume();
     }
 }
@@ -0,0 +1,72 @@
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "co.hpp"
+
+// 大量协程之间的切换速率，对比堆上分配和StackArena分配的栈
+//
+// usage: ./test_bench_switch [coroutines] [seconds] [arena]
+// - arena: 非0时使用env.useStackArena()
+
+// 每次切入时在栈上读写的字节数，模拟真实协程的栈访问
+constexpr static size_t TOUCH = 256;
+
+static bool running = true;
+
+void worker() {
+    while(running) {
+        volatile char frame[TOUCH];
+        for(size_t i = 0; i < TOUCH; i += 64) frame[i] = frame[i] + 1;
+        co::this_coroutine::yield();
+    }
+}
+
+int main(int argc, const char *argv[]) {
+    size_t n = argc > 1 ? ::atoi(argv[1]) : 10000;
+    int seconds = argc > 2 ? ::atoi(argv[2]) : 3;
+    bool arena = argc > 3 && ::atoi(argv[3]);
+
+    auto &env = co::open();
+    if(arena && !env.useStackArena()) {
+        std::cerr << "stack arena unavailable" << std::endl;
+        return -1;
+    }
+
+    std::vector<std::shared_ptr<co::Coroutine>> coroutines;
+    coroutines.reserve(n);
+    for(size_t i = 0; i < n; ++i) {
+        coroutines.emplace_back(env.createCoroutine(worker));
+        // 预热：完成Context的分配和首次切入
+        coroutines.back()->resume();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(seconds);
+    auto switches = env.statistics().switches.get();
+    size_t rounds = 0;
+    while(Clock::now() < deadline) {
+        for(auto &&coroutine : coroutines) {
+            coroutine->resume();
+        }
+        ++rounds;
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    switches = env.statistics().switches.get() - switches;
+
+    std::cout << "coroutines: " << n << ", arena: " << arena;
+    if(auto local = co::StackArena::local()) {
+        std::cout << " (node " << local->node()
+                  << ", " << (local->hugetlb() ? "hugetlb" : "thp")
+                  << ", " << local->regions() << " regions)";
+    }
+    std::cout << std::endl;
+    std::cout << "rounds: " << rounds << std::endl;
+    std::cout << "switches: " << size_t(switches / elapsed) << "/s" << std::endl;
+
+    // 让所有协程正常退出
+    running = false;
+    for(auto &&coroutine : coroutines) {
+        coroutine->resume();
+    }
+}
@@ -0,0 +1,157 @@
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "co.hpp"
+
+// 本地回环的UDP吞吐测试：co::sendmmsg -> co::recvmmsg
+//
+// usage: ./test_bench_udp [seconds] [batch] [payload] [gso]
+// - batch:   每次系统调用处理的消息数目
+// - payload: 每个datagram的大小
+// - gso:     非0时发送端使用UDP_SEGMENT，接收端使用UDP_GRO
+
+constexpr static uint16_t PORT = 2534;
+// 开启GSO时每个消息携带的datagram数目
+constexpr static size_t SEGMENTS = 32;
+
+static std::atomic<size_t> sent {};
+static std::atomic<size_t> received {};
+static std::atomic<size_t> receivedBytes {};
+
+sockaddr_in address();
+
+void sender(size_t batch, size_t payload, bool gso);
+void receiver(int fd, size_t batch, bool gso);
+
+int main(int argc, const char *argv[]) {
+    int seconds = argc > 1 ? ::atoi(argv[1]) : 5;
+    size_t batch = argc > 2 ? ::atoi(argv[2]) : 32;
+    size_t payload = argc > 3 ? ::atoi(argv[3]) : 1200;
+    bool gso = argc > 4 && ::atoi(argv[4]);
+
+    // 先bind再启动发送端
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    auto addr = address();
+    if(fd < 0 || ::bind(fd, (const sockaddr*)&addr, sizeof addr)) {
+        std::cerr << "bind: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int rcvbuf = 1 << 24;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof rcvbuf);
+
+    std::thread([=] {
+        auto &env = co::open();
+        auto co = env.createCoroutine(receiver, fd, batch, gso);
+        co->resume();
+        co::loop();
+    }).detach();
+
+    std::thread([=] {
+        auto &env = co::open();
+        auto co = env.createCoroutine(sender, batch, payload, gso);
+        co->resume();
+        co::loop();
+    }).detach();
+
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+
+    size_t datagrams = received;
+    size_t bytes = receivedBytes;
+    std::cout << "batch: " << batch
+              << ", payload: " << payload
+              << ", gso: " << gso << std::endl;
+    std::cout << "sent: " << sent / seconds << " datagrams/s" << std::endl;
+    std::cout << "received: " << datagrams / seconds << " datagrams/s, "
+              << double(bytes) / seconds / (1 << 20) << " MiB/s" << std::endl;
+    // 不等待工作线程
+    ::_exit(0);
+}
+
+sockaddr_in address() {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(PORT);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    return addr;
+}
+
+void sender(size_t batch, size_t payload, bool gso) {
+    int fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    auto addr = address();
+    if(fd < 0 || ::connect(fd, (const sockaddr*)&addr, sizeof addr)) {
+        std::cerr << "connect: " << strerror(errno) << std::endl;
+        ::exit(-1);
+    }
+    size_t segments = 1;
+    if(gso) {
+        if(co::setUdpSegment(fd, payload)) {
+            std::cerr << "UDP_SEGMENT: " << strerror(errno) << std::endl;
+            ::exit(-1);
+        }
+        segments = SEGMENTS;
+    }
+
+    std::vector<char> data(payload * segments, 'x');
+    std::vector<iovec> iovecs(batch);
+    std::vector<mmsghdr> messages(batch);
+    for(size_t i = 0; i < batch; ++i) {
+        iovecs[i] = {data.data(), data.size()};
+        messages[i].msg_hdr.msg_iov = &iovecs[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    while(1) {
+        int n = co::sendmmsg(fd, messages.data(), batch, 0);
+        if(n > 0) {
+            sent += n * segments;
+        } else if(n < 0 && errno != EAGAIN && errno != ECONNREFUSED) {
+            std::cerr << "sendmmsg: " << strerror(errno) << std::endl;
+            ::exit(-1);
+        }
+    }
+}
+
+void receiver(int fd, size_t batch, bool gso) {
+    if(gso && co::setUdpGro(fd)) {
+        std::cerr << "UDP_GRO: " << strerror(errno) << std::endl;
+        ::exit(-1);
+    }
+    // GRO合并后单个消息可达64KiB
+    const size_t capacity = gso ? 1 << 16 : 1 << 11;
+    constexpr size_t CONTROL = CMSG_SPACE(sizeof(int));
+
+    std::vector<char> data(capacity * batch);
+    std::vector<char> control(CONTROL * batch);
+    std::vector<iovec> iovecs(batch);
+    std::vector<mmsghdr> messages(batch);
+
+    while(1) {
+        for(size_t i = 0; i < batch; ++i) {
+            iovecs[i] = {data.data() + i * capacity, capacity};
+            messages[i] = {};
+            messages[i].msg_hdr.msg_iov = &iovecs[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+            messages[i].msg_hdr.msg_control = control.data() + i * CONTROL;
+            messages[i].msg_hdr.msg_controllen = CONTROL;
+        }
+        int n = co::recvmmsg(fd, messages.data(), batch, MSG_WAITFORONE);
+        if(n <= 0) continue;
+        size_t datagrams = 0;
+        size_t bytes = 0;
+        for(int i = 0; i < n; ++i) {
+            size_t length = messages[i].msg_len;
+            int segment = co::groSegmentSize(messages[i].msg_hdr);
+            datagrams += segment > 0 ? (length + segment - 1) / segment : 1;
+            bytes += length;
+        }
+        received += datagrams;
+        receivedBytes += bytes;
+    }
+}
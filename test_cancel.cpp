@@ -0,0 +1,85 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "co.hpp"
+
+// 取消与退出示例
+// - 空闲会话阻塞在co::read中，由Coroutine::cancel()以ECANCELED唤醒，栈立即回收
+// - co::stop()之后，loop()取消剩下的阻塞协程，等它们退出后返回
+//
+// usage: ./test_cancel [sessions]
+
+static size_t cancelled;
+
+void session(int fd) {
+    char buf[64];
+    for(;;) {
+        ssize_t n = co::read(fd, buf, sizeof buf);
+        if(n > 0) continue;
+        if(n < 0 && errno == EAGAIN) continue;
+        if(n < 0 && errno == ECANCELED) ++cancelled;
+        break;
+    }
+    ::close(fd);
+}
+
+int main(int argc, const char *argv[]) {
+    size_t sessions = argc > 1 ? ::atoi(argv[1]) : 1000;
+    auto &env = co::open();
+    auto &statistics = env.statistics();
+
+    std::vector<std::shared_ptr<co::Coroutine>> coroutines;
+    std::vector<int> peers;
+    for(size_t i = 0; i < sessions; ++i) {
+        int fds[2];
+        if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)) {
+            std::cerr << "socketpair: " << ::strerror(errno) << std::endl;
+            return -1;
+        }
+        peers.emplace_back(fds[1]);
+        coroutines.emplace_back(env.createCoroutine(session, fds[0]));
+        coroutines.back()->resume();
+    }
+    std::cout << "parked sessions: " << sessions
+              << ", events: " << co::getPollConfig().events.size() << std::endl;
+
+    // 一个后台的sleep，以及等待子协程的TaskGroup，由co::stop()统一取消
+    env.createCoroutine([] {
+        unsigned int remain = co::sleep(3600);
+        std::cout << "sleep cancelled, remain: " << remain
+                  << "s, errno: " << ::strerror(errno) << std::endl;
+    })->resume();
+    env.createCoroutine([] {
+        co::TaskGroup group;
+        for(int i = 0; i < 4; ++i) {
+            group.spawn([] { return co::usleep(999999); });
+        }
+        group.wait_all();
+        std::cout << "task group drained, cancelled: " << group.cancelled() << std::endl;
+    })->resume();
+
+    // 内存紧张时关闭一半的空闲会话
+    env.createCoroutine([&] {
+        auto before = statistics.exited.get();
+        for(size_t i = 0; i < sessions / 2; ++i) {
+            coroutines[i]->cancel();
+        }
+        // 被取消的会话在下一轮loop中退出
+        co::usleep(1000);
+        std::cout << "cancelled: " << cancelled
+                  << ", exited: " << statistics.exited.get() - before
+                  << ", events: " << co::getPollConfig().events.size() << std::endl;
+        co::stop(std::chrono::milliseconds(10));
+    })->resume();
+
+    co::loop();
+
+    std::cout << "loop returned, cancelled: " << cancelled
+              << ", events: " << co::getPollConfig().events.size()
+              << ", exited: " << statistics.exited.get() << std::endl;
+    for(int fd : peers) ::close(fd);
+}
@@ -0,0 +1,103 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <iostream>
+#include <string>
+#include "co.hpp"
+
+// 写合并示例
+// 1. 同一轮内的多次co::write只追加到输出缓冲区，loop()处理完这一批事件后用一次::write写出
+// 2. 缓冲区超过阈值并且socket写不进去时，写者等待EPOLLOUT
+// 3. 关闭写合并时先写出剩下的数据，之后才能close(fd)
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+constexpr size_t BULK = 256 << 10;
+constexpr size_t TAIL = 32 << 10;
+
+bool elapsed(Clock::time_point start, milliseconds duration) {
+    return Clock::now() - start >= duration;
+}
+
+void writer(int fd) {
+    auto &statistics = co::open().statistics();
+    auto &config = co::getPollConfig();
+    co::coalesce(fd);
+
+    char frames[][10] = {"jojo ", "dio ", "zawarudo"};
+    uint64_t flushes = statistics.flushes;
+    for(auto &&frame : frames) {
+        co::write(fd, frame, ::strlen(frame));
+    }
+    std::cout << "pending after 3 writes: " << config.outputs[fd].pending()
+              << ", flushes: " << statistics.flushes - flushes << std::endl;
+    // 让loop()写出
+    co::usleep(1000);
+    std::cout << "flushes after the tick: " << statistics.flushes - flushes << std::endl;
+
+    // 读者暂时不读，socket的缓冲区被填满
+    std::string chunk(4096, 'x');
+    auto start = Clock::now();
+    for(size_t written = 0; written < BULK; written += chunk.size()) {
+        if(co::write(fd, &chunk[0], chunk.size()) < 0) return;
+    }
+    std::cout << "bulk writer waited for EPOLLOUT: " << elapsed(start, milliseconds(10)) << std::endl;
+
+    // 低于阈值的数据只在缓冲区中，关闭写合并时写出
+    std::string tail(TAIL, 'y');
+    co::write(fd, &tail[0], tail.size());
+    std::cout << "tail pending before coalesce(fd, false): " << (config.outputs[fd].pending() >= TAIL) << std::endl;
+    start = Clock::now();
+    int ret = co::coalesce(fd, false);
+    std::cout << "coalesce(fd, false): " << ret
+              << ", waited: " << elapsed(start, milliseconds(10)) << std::endl;
+    ::close(fd);
+}
+
+void reader(int fd) {
+    char buf[1 << 16];
+    ssize_t n = co::read(fd, buf, sizeof buf);
+    std::cout << "first read: " << std::string(buf, n > 0 ? n : 0) << std::endl;
+
+    // 等写者填满socket的缓冲区之后再读
+    co::usleep(50000);
+    size_t received = 0;
+    while(received < BULK) {
+        n = co::read(fd, buf, std::min(sizeof buf, BULK - received));
+        if(n < 0 && errno == EAGAIN) continue;
+        if(n <= 0) break;
+        received += n;
+    }
+    // 写者此时阻塞在co::coalesce(fd, false)中，读到EOF为止
+    co::usleep(50000);
+    while((n = co::read(fd, buf, sizeof buf)) != 0) {
+        if(n < 0 && errno == EAGAIN) continue;
+        if(n < 0) break;
+        received += n;
+    }
+    std::cout << "received: " << received << ", expected: " << BULK + TAIL << std::endl;
+    ::close(fd);
+    co::stop();
+}
+
+int main() {
+    int fds[2];
+    if(::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds)) return 1;
+    int size = 4096;
+    ::setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof size);
+    ::setsockopt(fds[1], SOL_SOCKET, SO_RCVBUF, &size, sizeof size);
+
+    auto &env = co::open();
+    env.createCoroutine(reader, fds[1])->resume();
+    env.createCoroutine(writer, fds[0])->resume();
+    co::loop();
+}
+
+// expected output:
+// pending after 3 writes: 17, flushes: 0
+// first read: jojo dio zawarudo
+// flushes after the tick: 1
+// bulk writer waited for EPOLLOUT: 1
+// tail pending before coalesce(fd, false): 1
+// coalesce(fd, false): 0, waited: 1
+// received: 294912, expected: 294912
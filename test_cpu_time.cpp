@@ -0,0 +1,66 @@
+#include <iostream>
+#include "co.hpp"
+
+// CPU时间统计示例：Environment::accountCpu()与longSliceThreshold()
+// 每个协程累计自己的CPU时间，两次让出之间计算过久的时间片连同入口记录下来
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::milliseconds;
+
+void burn(milliseconds duration) {
+    auto until = Clock::now() + duration;
+    while(Clock::now() < until);
+}
+
+struct Light {
+    void operator()() const {
+        for(int i = 0; i < 5; ++i) co::this_coroutine::yield();
+    }
+};
+
+struct Heavy {
+    void operator()() const {
+        for(int i = 0; i < 3; ++i) {
+            burn(milliseconds(3));
+            co::this_coroutine::yield();
+        }
+    }
+};
+
+uint64_t toMilliseconds(uint64_t cycles) {
+    return co::Tsc::toNanoseconds(cycles) / 1000000;
+}
+
+int main() {
+    auto &env = co::open();
+    env.accountCpu(true);
+    env.longSliceThreshold(milliseconds(1));
+
+    auto light = env.createCoroutine(Light{});
+    auto heavy = env.createCoroutine(Heavy{});
+    while(!light->exit() || !heavy->exit()) {
+        light->resume();
+        heavy->resume();
+    }
+
+    // 每次切入到切出为一个时间片，最后一次恢复直到退出也算一个
+    auto &lightTime = light->cpuTime();
+    auto &heavyTime = heavy->cpuTime();
+    std::cout << "Light: slices " << lightTime.slices
+              << ", total < 1ms: " << (toMilliseconds(lightTime.cycles) < 1) << std::endl;
+    std::cout << "Heavy: slices " << heavyTime.slices
+              << ", total >= 9ms: " << (toMilliseconds(heavyTime.cycles) >= 9)
+              << ", max slice >= 3ms: " << (toMilliseconds(heavyTime.maxSlice) >= 3) << std::endl;
+
+    auto &slices = env.longSlices();
+    bool allHeavy = true;
+    for(size_t i = 0; i < slices.size(); ++i) {
+        allHeavy = allHeavy && slices[i].entry.name() == "Heavy";
+    }
+    std::cout << "long slices: " << slices.total() << ", all Heavy: " << allHeavy << std::endl;
+}
+
+// expected output:
+// Light: slices 6, total < 1ms: 1
+// Heavy: slices 4, total >= 9ms: 1, max slice >= 3ms: 1
+// long slices: 3, all Heavy: 1
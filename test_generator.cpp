@@ -0,0 +1,59 @@
+#include <iostream>
+#include <string>
+#include "co.hpp"
+
+// 逐行切分的生成器，模拟从缓冲区中解析出一帧帧数据
+void lines(const std::string &text) {
+    size_t start = 0;
+    for(size_t i = 0; i < text.size(); ++i) {
+        if(text[i] == '\n') {
+            co::Generator<std::string>::yield(text.substr(start, i - start));
+            start = i + 1;
+        }
+    }
+}
+
+// 提前放弃迭代时，生成器栈上的对象同样会析构
+struct Guard {
+    ~Guard() { std::cout << "released" << std::endl; }
+};
+
+void naturals() {
+    Guard guard;
+    for(size_t i = 0;; ++i) co::Generator<size_t>::yield(i);
+}
+
+int main() {
+    auto &env = co::open();
+    auto co = env.createCoroutine([] {
+        co::Generator<std::string> frames(lines, "jojo\ndio\nzawarudo\n");
+        // 生成器可以串联，每一级都是惰性的
+        co::Generator<size_t> lengths([&] {
+            for(auto &&frame : frames) {
+                auto length = frame.size();
+                co::Generator<size_t>::yield(length);
+            }
+        });
+        for(auto &&length : lengths) {
+            std::cout << length << std::endl;
+        }
+        co::Generator<size_t> numbers(naturals);
+        for(auto &&n : numbers) {
+            if(n == 2) break;
+        }
+        // 重新赋值时，原来的生成器同样被放弃
+        numbers = co::Generator<size_t>([] {
+            co::Generator<size_t>::yield(size_t(42));
+        });
+        for(auto &&n : numbers) {
+            std::cout << n << std::endl;
+        }
+    });
+    co->resume();
+    return 0;
+}
+// 4
+// 3
+// 8
+// released
+// 42
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <string>
+#include "co.hpp"
+
+// 协程局部存储示例：co::local<T>
+// 两个协程交替运行，各自的值互不覆盖；协程退出时值随之析构
+
+struct Guard {
+    std::string name;
+    ~Guard() { if(!name.empty()) std::cout << "release " << name << std::endl; }
+};
+
+static co::local<std::string> requestId;
+static co::local<int> counter;
+static co::local<Guard> guard;
+
+void handle(std::string id) {
+    *requestId = id;
+    guard->name = id;
+    for(int i = 0; i < 2; ++i) {
+        ++*counter;
+        co::this_coroutine::yield();
+        // 另一个协程在此期间写入了自己的值
+        std::cout << id << ": requestId " << *requestId << ", counter " << *counter << std::endl;
+    }
+}
+
+int main() {
+    auto &env = co::open();
+    *requestId = "main";
+
+    auto a = env.createCoroutine(handle, "a");
+    auto b = env.createCoroutine(handle, "b");
+    while(!a->exit() || !b->exit()) {
+        a->resume();
+        b->resume();
+    }
+    std::cout << "main: requestId " << *requestId << ", has counter " << counter.has() << std::endl;
+
+    // 可以读取其他协程的值，reset()提前析构当前协程的值
+    auto c = env.createCoroutine([] {
+        guard->name = "c";
+        co::this_coroutine::yield();
+        guard.reset();
+        std::cout << "c: has guard " << guard.has() << std::endl;
+    });
+    c->resume();
+    std::cout << "c's guard from main: " << guard.get(*c).name << std::endl;
+    c->resume();
+}
+
+// expected output:
+// a: requestId a, counter 1
+// b: requestId b, counter 1
+// a: requestId a, counter 2
+// release a
+// b: requestId b, counter 2
+// release b
+// main: requestId main, has counter 0
+// c's guard from main: c
+// release c
+// c: has guard 0
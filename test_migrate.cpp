@@ -0,0 +1,157 @@
+#include <unistd.h>
+#include <signal.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+#include "co.hpp"
+
+// 连接迁移示例：只有loop 0在accept，所有会话一开始都在同一个线程上
+// 每个请求都要消耗一段CPU时间，loop 0过载后会话经由co::LoopGroup迁移到其它loop
+//
+// usage: ./test_migrate [loops] [sessions] [seconds] [work(us)]
+
+using Clock = std::chrono::steady_clock;
+
+static uint16_t port = 2340;
+static int loops = 2;
+static size_t sessions = 16;
+static int seconds = 3;
+static int work = 200;
+
+static co::LoopGroup group(8);
+static std::atomic<size_t> served[8];
+static Clock::time_point deadline;
+// 当前线程在group中的下标
+static thread_local int loopIndex;
+
+void burn(std::chrono::microseconds duration) {
+    auto until = Clock::now() + duration;
+    while(Clock::now() < until);
+}
+
+// 每个请求为1字节，回复1字节
+void session(int fd) {
+    char c;
+    for(;;) {
+        ssize_t n = co::read(fd, &c, 1);
+        if(n == 0 || (n < 0 && errno != EAGAIN)) break;
+        if(n < 0) continue;
+        burn(std::chrono::microseconds(work));
+        if(co::write(fd, &c, 1) != 1) break;
+        ++served[loopIndex];
+        if(group.rebalance(fd, session)) return;
+    }
+    ::close(fd);
+}
+
+int prepare() {
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int opt = 1;
+    ::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt, static_cast<socklen_t>(sizeof opt));
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
+    if(::bind(server, (const sockaddr*)&addr, sizeof addr) || ::listen(server, SOMAXCONN)) {
+        ::exit(-1);
+    }
+    return server;
+}
+
+void listener(int server) {
+    for(;;) {
+        int connection = co::accept4(server, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(connection < 0 && errno == ECANCELED) break;
+        if(connection <= 0) continue;
+        int optval = true;
+        ::setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &optval,
+                static_cast<socklen_t>(sizeof optval));
+        group.spawn(connection, session);
+    }
+    ::close(server);
+}
+
+void client() {
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(port);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    if(fd < 0 || co::connect(fd, (const sockaddr*)&addr, sizeof addr)) {
+        ::close(fd);
+        return;
+    }
+    char c = 'x';
+    while(Clock::now() < deadline) {
+        if(co::write(fd, &c, 1) != 1) break;
+        ssize_t n;
+        while((n = co::read(fd, &c, 1)) < 0 && errno == EAGAIN);
+        if(n <= 0) break;
+    }
+    ::close(fd);
+}
+
+int main(int argc, const char *argv[]) {
+    if(argc > 1) loops = std::min(std::max(::atoi(argv[1]), 1), 8);
+    if(argc > 2) sessions = ::atoi(argv[2]);
+    if(argc > 3) seconds = ::atoi(argv[3]);
+    if(argc > 4) work = ::atoi(argv[4]);
+    ::signal(SIGPIPE, SIG_IGN);
+    deadline = Clock::now() + std::chrono::seconds(seconds);
+
+    std::vector<std::thread> threads;
+    for(int t = 0; t < loops; ++t) {
+        threads.emplace_back([t] {
+            auto &env = co::open();
+            // 只有loop 0接受连接
+            if(t == 0) env.createCoroutine(listener, prepare())->resume();
+            loopIndex = group.join();
+            env.createCoroutine([] {
+                co::sleep(seconds + 1);
+                co::stop();
+            })->resume();
+            co::loop();
+        });
+    }
+    // 等所有loop加入
+    while(group.size() < size_t(loops)) std::this_thread::yield();
+
+    std::thread([] {
+        auto &env = co::open();
+        env.createCoroutine([] {
+            co::TaskGroup clients;
+            for(size_t i = 0; i < sessions; ++i) {
+                clients.spawn(client);
+            }
+        })->resume();
+        co::loop();
+    }).detach();
+
+    for(auto &&thread : threads) thread.join();
+
+    size_t total = 0;
+    for(int i = 0; i < loops; ++i) total += served[i];
+    for(int i = 0; i < loops; ++i) {
+        std::cout << "loop " << i << ": served " << served[i]
+                  << " (" << (total ? served[i] * 100 / total : 0) << "%)"
+                  << ", migrated in " << group.migratedIn(i)
+                  << ", out " << group.migratedOut(i) << std::endl;
+    }
+    // 以迁移之后的预估负载比较，并且每个会话迁入后至少停留dwell，会话不会来回迁移
+    size_t migrations = 0;
+    for(int i = 0; i < loops; ++i) migrations += group.migratedOut(i);
+    bool bounded = migrations <= sessions;
+    std::cout << "migrations: " << migrations << ", bounded: " << bounded << std::endl;
+    return bounded ? 0 : 1;
+}
+
+// expected output:
+// loop 0: served 7453 (55%), migrated in 0, out 4
+// loop 1: served 5896 (44%), migrated in 4, out 0
+// migrations: 4, bounded: 1
@@ -0,0 +1,94 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <iostream>
+#include "co.hpp"
+
+// 编译期配置示例：关闭统计、跟踪和CPU时间统计，使用更小的栈和poll(2)后端
+// 默认配置与Lean配置的Environment在同一个线程中共存，各自切换和loop()
+// Lean配置下resume / yield只剩下切换本身
+//
+// usage: ./test_policy [seconds]
+
+struct Lean: co::DefaultPolicy {
+    constexpr static size_t STACK_SIZE = 1 << 16;
+    constexpr static size_t RECYCLE_CAPACITY = 1024;
+    constexpr static bool STATISTICS = false;
+    constexpr static bool TRACING = false;
+    constexpr static bool PROFILING = false;
+    using StackAllocator = co::HeapStackAllocator;
+    using Backend = co::PollBackend;
+};
+
+static_assert(std::is_same<co::Environment::Policy, co::DefaultPolicy>::value, "default");
+static_assert(co::BasicContext<Lean>::STACK_SIZE == Lean::STACK_SIZE, "stack size");
+static_assert(co::Context::STACK_SIZE == co::DefaultPolicy::STACK_SIZE, "stack size");
+
+// 每秒切换次数
+template <typename Policy>
+size_t bench(co::BasicEnvironment<Policy> &env, int seconds) {
+    size_t switches = 0;
+    bool running = true;
+    auto coroutine = env.createCoroutine([&] {
+        while(running) co::this_coroutine::yield<Policy>();
+    });
+
+    using Clock = std::chrono::steady_clock;
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(seconds);
+    while(Clock::now() < deadline) {
+        for(int i = 0; i < 1000; ++i) {
+            coroutine->resume();
+        }
+        switches += 2000;
+    }
+    auto elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    running = false;
+    coroutine->resume();
+    return switches / elapsed;
+}
+
+int main(int argc, const char *argv[]) {
+    int seconds = argc > 1 ? ::atoi(argv[1]) : 1;
+    auto &env = co::open();
+    auto &lean = co::open<Lean>();
+
+    // Lean的运行时开关不再起作用
+    lean.tracing(true);
+    lean.accountCpu(true);
+    std::cout << "accountCpu: " << env.accountCpu() << " / " << lean.accountCpu()
+              << ", useStackArena: " << env.useStackArena() << " / " << lean.useStackArena() << std::endl;
+
+    auto defaultRate = bench(env, seconds);
+    auto leanRate = bench(lean, seconds);
+    std::cout << "switches: " << defaultRate << "/s / " << leanRate << "/s" << std::endl;
+    // 统计关闭时恒为0
+    std::cout << "statistics.switches: " << (env.statistics().switches > 0)
+              << " / " << lean.statistics().switches << std::endl;
+
+    // Lean的loop()使用PollBackend
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK)) return 1;
+    lean.createCoroutine([&] {
+        char buf[16] {};
+        ssize_t n = co::read<Lean>(fds[0], buf, sizeof buf);
+        std::cout << "lean read: " << std::string(buf, n > 0 ? n : 0) << std::endl;
+        co::stop<Lean>();
+    })->resume();
+    lean.createCoroutine([&] {
+        co::usleep<Lean>(1000);
+        char msg[] = "jojo";
+        co::write<Lean>(fds[1], msg, 4);
+    })->resume();
+    co::loop<Lean>();
+    ::close(fds[0]);
+    ::close(fds[1]);
+    std::cout << "default poll: " << co::getPollConfig().events.size()
+              << ", lean poll: " << co::getPollConfig<Lean>().events.size() << std::endl;
+}
+
+// expected output:
+// accountCpu: 0 / 0, useStackArena: 1 / 0
+// switches: 35000000/s / 39000000/s
+// statistics.switches: 1 / 0
+// lean read: jojo
+// default poll: 0, lean poll: 0
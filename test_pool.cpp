@@ -0,0 +1,106 @@
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include <thread>
+#include "co.hpp"
+
+// 连接池示例：回显服务器运行在另一个线程
+// 客户端协程每次请求都从co::ConnectionPool借出连接，请求完成后归还
+//
+// usage: ./test_pool [clients] [requests]
+
+constexpr static uint16_t PORT = 2536;
+
+sockaddr_in address();
+void server();
+void echo(int fd);
+void client(size_t requests);
+
+// 同一线程上的客户端，不需要原子变量
+static size_t remaining;
+static size_t completed;
+
+int main(int argc, const char *argv[]) {
+    size_t clients = argc > 1 ? ::atoi(argv[1]) : 100;
+    size_t requests = argc > 2 ? ::atoi(argv[2]) : 100;
+    ::signal(SIGPIPE, SIG_IGN);
+
+    std::thread(server).detach();
+    // 等待服务器启动
+    ::usleep(100000);
+
+    auto &env = co::open();
+    auto &pool = co::getConnectionPool();
+    pool.maxConnections = 8;
+    remaining = clients;
+    for(size_t i = 0; i < clients; ++i) {
+        env.createCoroutine(client, requests)->resume();
+    }
+    co::loop();
+}
+
+sockaddr_in address() {
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(PORT);
+    addr.sin_addr.s_addr = ::inet_addr("127.0.0.1");
+    return addr;
+}
+
+void server() {
+    auto &env = co::open();
+    env.createCoroutine([&env] {
+        int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof on);
+        auto addr = address();
+        if(::bind(fd, (const sockaddr*)&addr, sizeof addr) || ::listen(fd, 128)) {
+            std::cerr << "listen: " << strerror(errno) << std::endl;
+            ::exit(-1);
+        }
+        while(1) {
+            int client = co::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(client >= 0) env.createCoroutine(echo, client)->resume();
+        }
+    })->resume();
+    co::loop();
+}
+
+void echo(int fd) {
+    char buf[256];
+    while(1) {
+        int n = co::read(fd, buf, sizeof buf);
+        if(n > 0) n = co::write(fd, buf, n);
+        if(n == 0 || (n < 0 && errno != EAGAIN)) break;
+    }
+    ::close(fd);
+}
+
+void client(size_t requests) {
+    auto &pool = co::getConnectionPool();
+    auto addr = address();
+    char request[] = "jojo";
+    char response[sizeof request];
+    for(size_t i = 0; i < requests; ++i) {
+        auto connection = pool.checkout((const sockaddr*)&addr, sizeof addr);
+        if(!connection) {
+            std::cerr << "checkout: " << strerror(errno) << std::endl;
+            ::exit(-1);
+        }
+        if(co::write(connection.fd(), request, sizeof request) != sizeof request
+                || co::read(connection.fd(), response, sizeof response) != sizeof response) {
+            // 不确定连接的状态，不再复用
+            connection.close();
+            continue;
+        }
+        ++completed;
+    }
+    if(--remaining == 0) {
+        std::cout << "requests: " << completed
+                  << ", connects: " << pool.connects()
+                  << ", idle: " << pool.idle() << std::endl;
+        ::exit(0);
+    }
+}
@@ -0,0 +1,57 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include "co.hpp"
+
+// 一个纯计算的协程和一个每毫秒醒来一次的协程共享同一个线程
+// 开启抢占后，后者的最大间隔受budget约束，而不是等前者算完
+//
+// usage: ./test_preempt [hard]
+
+using Clock = std::chrono::steady_clock;
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+
+void compute(bool hard) {
+    volatile uint64_t sum = 0;
+    if(hard) {
+        // 强制抢占：作用域内只有纯计算
+        co::Preemptible preemptible;
+        for(uint64_t i = 0; i < 1000000000; ++i) sum = sum + i;
+    } else {
+        // 协作式：定期经过安全点
+        for(uint64_t i = 0; i < 1000000000; ++i) {
+            sum = sum + i;
+            if(i % 65536 == 0) co::this_coroutine::maybe_yield();
+        }
+    }
+    std::cout << "compute done" << std::endl;
+}
+
+void ticker() {
+    auto last = Clock::now();
+    microseconds worst {};
+    for(int i = 0; i < 100; ++i) {
+        co::usleep(1000);
+        auto now = Clock::now();
+        worst = std::max(worst, duration_cast<microseconds>(now - last));
+        last = now;
+    }
+    std::cout << "ticker worst gap: " << worst.count() << "us" << std::endl;
+}
+
+int main(int argc, const char *argv[]) {
+    bool hard = argc > 1 && ::strcmp(argv[1], "hard") == 0;
+    auto &env = co::open();
+    if(co::preempt(std::chrono::milliseconds(2), hard)) {
+        std::cerr << "preempt: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    env.createCoroutine(ticker)->resume();
+    env.createCoroutine(compute, hard)->resume();
+    env.createCoroutine([] {
+        co::sleep(3);
+        ::exit(0);
+    })->resume();
+    co::loop();
+}
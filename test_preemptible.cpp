@@ -0,0 +1,64 @@
+#include <cstring>
+#include <iostream>
+#include "co.hpp"
+
+// 强制抢占只作用于位于Preemptible作用域内的协程
+// 一个协程在作用域内被信号处理函数切走以后，同一线程上的其它协程仍然只会在安全点让出
+//
+// usage: ./test_preemptible
+
+using Clock = std::chrono::steady_clock;
+
+volatile uint64_t sink;
+
+// 不经过任何安全点地计算chunks毫秒，返回其间被切走的次数
+int spin(int chunks) {
+    auto &switches = co::open().statistics().switches;
+    int interrupted = 0;
+    for(int i = 0; i < chunks; ++i) {
+        auto before = switches.get();
+        auto deadline = Clock::now() + std::chrono::milliseconds(1);
+        while(Clock::now() < deadline) sink = sink + 1;
+        if(switches.get() != before) ++interrupted;
+    }
+    return interrupted;
+}
+
+int main() {
+    auto &env = co::open();
+    if(co::preempt(std::chrono::milliseconds(2), true)) {
+        std::cerr << "preempt: " << strerror(errno) << std::endl;
+        return -1;
+    }
+    int running = 2;
+    auto done = [&] { if(--running == 0) co::stop(); };
+
+    env.createCoroutine([&] {
+        // 等到另一个协程进入作用域
+        co::usleep(1000);
+        int interrupted = 0;
+        for(int round = 0; round < 10; ++round) {
+            interrupted += spin(20);
+            co::this_coroutine::maybe_yield();
+        }
+        std::cout << "plain coroutine interrupted: " << interrupted << std::endl;
+        done();
+    })->resume();
+
+    env.createCoroutine([&] {
+        int interrupted;
+        {
+            co::Preemptible preemptible;
+            interrupted = spin(200);
+        }
+        std::cout << "preemptible coroutine interrupted: " << (interrupted > 0) << std::endl;
+        done();
+    })->resume();
+
+    co::loop();
+    co::preempt({});
+}
+
+// expected output:
+// plain coroutine interrupted: 0
+// preemptible coroutine interrupted: 1
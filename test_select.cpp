@@ -0,0 +1,81 @@
+#include <sys/socket.h>
+#include <iostream>
+#include <string>
+#include "co.hpp"
+
+// select示例：一个协程同时转发两个方向的数据，空闲超时后关闭
+// 管理命令通过co::Channel送到同一个协程
+//
+// usage: ./test_select
+
+using namespace std::chrono;
+
+static co::Channel<std::string> commands;
+
+// 把from中已有的数据转发到to，对端关闭时返回false
+bool relay(int from, int to, const char *direction) {
+    char buf[1024];
+    ssize_t n = co::read(from, buf, sizeof buf);
+    if(n <= 0) return false;
+    std::cout << direction << ": " << std::string(buf, n) << std::endl;
+    co::write(to, buf, n);
+    return true;
+}
+
+// client <-> [proxy] <-> upstream，只用一个协程
+void proxy(int client, int upstream) {
+    for(bool running = true; running;) {
+        std::string command;
+        switch(co::select({co::readable(client), co::readable(upstream),
+                           co::readable(commands), co::after(milliseconds(100))})) {
+            case 0:
+                running = relay(client, upstream, "client -> upstream");
+                break;
+            case 1:
+                running = relay(upstream, client, "upstream -> client");
+                break;
+            case 2:
+                if(commands.tryPop(command)) {
+                    std::cout << "command: " << command << std::endl;
+                    running = command != "stop";
+                }
+                break;
+            case 3:
+                std::cout << "idle timeout" << std::endl;
+                running = false;
+                break;
+            default:
+                ::perror("select");
+                running = false;
+        }
+    }
+    ::close(client);
+    ::close(upstream);
+}
+
+void peer(int fd, const char *message, int delay) {
+    co::poll(nullptr, 0, delay);
+    co::write(fd, (void*)message, ::strlen(message));
+    char buf[1024];
+    ssize_t n = co::read(fd, buf, sizeof buf);
+    if(n > 0) std::cout << "peer got: " << std::string(buf, n) << std::endl;
+}
+
+int main() {
+    auto &env = co::open();
+    int client[2], upstream[2];
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, client);
+    ::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, upstream);
+
+    env.createCoroutine(proxy, client[0], upstream[0])->resume();
+    env.createCoroutine(peer, client[1], "GET /", 10)->resume();
+    env.createCoroutine(peer, upstream[1], "200 OK", 30)->resume();
+    env.createCoroutine([] {
+        co::poll(nullptr, 0, 50);
+        commands.push("stats");
+        // 之后没有任何数据，由空闲超时结束
+        co::poll(nullptr, 0, 300);
+        ::exit(0);
+    })->resume();
+    co::loop();
+}
@@ -0,0 +1,53 @@
+#include <time.h>
+#include <iostream>
+#include "co.hpp"
+
+// 忙轮询示例：PollConfig::spin
+// 最近一次有事件到来后的spin时间内，loop()以epoll_wait(timeout = 0)轮询，占用CPU
+// 超出预算后退回到阻塞等待，空闲时不再占用CPU
+
+using std::chrono::milliseconds;
+using std::chrono::nanoseconds;
+
+nanoseconds threadCpu() {
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return std::chrono::seconds(ts.tv_sec) + nanoseconds(ts.tv_nsec);
+}
+
+// 在loop()中睡眠50ms，期间的epoll_wait次数以及CPU占用
+void idle(const char *name) {
+    constexpr auto DURATION = milliseconds(50);
+    auto &statistics = co::open().statistics();
+    uint64_t polls = statistics.polls;
+    auto cpu = threadCpu();
+    co::usleep(std::chrono::microseconds(DURATION).count());
+    polls = statistics.polls - polls;
+    cpu = threadCpu() - cpu;
+    std::cout << name << ": polls > 100: " << (polls > 100)
+              << ", busy >= 15ms: " << (cpu >= milliseconds(15))
+              << ", idle >= 15ms: " << (DURATION - cpu >= milliseconds(15)) << std::endl;
+}
+
+int main() {
+    auto &env = co::open();
+    env.createCoroutine([] {
+        auto &config = co::getPollConfig();
+        // 预算内一直轮询，之后阻塞剩下的时间
+        config.spin = milliseconds(20);
+        idle("spin 20ms");
+        // 预算超过等待时间，全程轮询
+        config.spin = milliseconds(100);
+        idle("spin 100ms");
+        // 不启用时直接阻塞到定时器到期
+        config.spin = {};
+        idle("spin 0");
+        co::stop();
+    })->resume();
+    co::loop();
+}
+
+// expected output:
+// spin 20ms: polls > 100: 1, busy >= 15ms: 1, idle >= 15ms: 1
+// spin 100ms: polls > 100: 1, busy >= 15ms: 1, idle >= 15ms: 0
+// spin 0: polls > 100: 0, busy >= 15ms: 0, idle >= 15ms: 1
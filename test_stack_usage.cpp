@@ -0,0 +1,68 @@
+#include <iostream>
+#include "co.hpp"
+
+// 栈染色示例：Environment::paintStacks()与stackUsage()
+// 协程退出时得到栈的high-water mark，按入口分组记录，用于调整Policy::STACK_SIZE
+
+// 在栈上使用约size字节，每一层1K
+void touch(size_t size) {
+    volatile char buf[1024];
+    buf[0] = 1;
+    if(size > sizeof buf) touch(size - sizeof buf);
+    buf[sizeof buf - 1] = buf[0];
+}
+
+struct Shallow {
+    void operator()() const {}
+};
+
+struct Deep {
+    void operator()() const {
+        touch(16 << 10);
+        // 运行中的协程同样可以查看
+        co::this_coroutine::yield();
+        touch(40 << 10);
+    }
+};
+
+int main() {
+    auto &env = co::open();
+    env.paintStacks(true);
+
+    for(int i = 0; i < 3; ++i) {
+        env.createCoroutine(Shallow{})->resume();
+    }
+    std::shared_ptr<co::Coroutine> deep;
+    for(int i = 0; i < 2; ++i) {
+        deep = env.createCoroutine(Deep{});
+        deep->resume();
+        auto running = deep->stackHighWater();
+        std::cout << "running Deep: >= 16K: " << (running >= (16 << 10))
+                  << ", < 32K: " << (running < (32 << 10)) << std::endl;
+        deep->resume();
+    }
+
+    auto &usage = env.stackUsage();
+    for(auto &&entry : {co::EntryPoint::make(Shallow{}), co::EntryPoint::make(Deep{})}) {
+        auto &record = usage.entries().at(entry);
+        std::cout << entry.name() << ": count " << record.count
+                  << ", max >= 40K: " << (record.max >= (40 << 10))
+                  << ", bucket " << (1 << co::StackUsage::bucket(record.max)) << "K" << std::endl;
+    }
+    std::cout << "total: " << usage.total().count << std::endl;
+
+    // 染色之前创建的Context上无效
+    env.paintStacks(false);
+    auto plain = env.createCoroutine(Deep{});
+    plain->resume();
+    std::cout << "unpainted: " << plain->stackHighWater() << std::endl;
+    plain->resume();
+}
+
+// expected output:
+// running Deep: >= 16K: 1, < 32K: 1
+// running Deep: >= 16K: 1, < 32K: 1
+// Shallow: count 3, max >= 40K: 0, bucket 1K
+// Deep: count 2, max >= 40K: 1, bucket 64K
+// total: 5
+// unpainted: 0
@@ -0,0 +1,67 @@
+#include <iostream>
+#include <thread>
+#include "co.hpp"
+
+// 调度统计示例：Environment::statistics()以及Statistics::aggregate()
+// Statistics拷贝即为快照，两个快照的差值就是期间的计数
+
+// 两个快照之间的差值
+#define DELTA(field) (after.field - before.field)
+
+int main() {
+    auto &env = co::open();
+
+    // 切换：每次resume和yield各一次，退出时切回调用者也算一次
+    auto before = env.statistics();
+    auto co = env.createCoroutine([] {
+        for(int i = 0; i < 3; ++i) co::this_coroutine::yield();
+    });
+    while(!co->exit()) co->resume();
+    auto after = env.statistics();
+    std::cout << "created: " << DELTA(created)
+              << ", exited: " << DELTA(exited)
+              << ", switches: " << DELTA(switches) << std::endl;
+
+    // 退出协程的Context进入回收栈，下一个协程直接复用
+    before = env.statistics();
+    for(int i = 0; i < 10; ++i) {
+        env.createCoroutine([] {})->resume();
+    }
+    after = env.statistics();
+    std::cout << "recycle hits: " << DELTA(recycleHits)
+              << ", misses: " << DELTA(recycleMisses)
+              << ", recycled: " << DELTA(recycled) << std::endl;
+
+    // 定时器、epoll_wait以及epoll_ctl
+    env.createCoroutine([&] {
+        before = env.statistics();
+        co::usleep(1000);
+        after = env.statistics();
+        std::cout << "timers: " << DELTA(timers)
+                  << ", controls: " << DELTA(controls)
+                  << ", polls > 0: " << (DELTA(polls) > 0) << std::endl;
+        co::stop();
+    })->resume();
+    env.createCoroutine([&] {
+        std::cout << "timers while sleeping: " << env.statistics().timers << std::endl;
+    })->resume();
+    co::loop();
+
+    // 汇总所有线程，包括已经退出的线程
+    auto created = co::Statistics::aggregate().created;
+    std::thread([] {
+        auto &env = co::open();
+        for(int i = 0; i < 5; ++i) {
+            env.createCoroutine([] {})->resume();
+        }
+    }).join();
+    std::cout << "aggregate created by the other thread: "
+              << co::Statistics::aggregate().created - created << std::endl;
+}
+
+// expected output:
+// created: 1, exited: 1, switches: 8
+// recycle hits: 10, misses: 0, recycled: 10
+// timers while sleeping: 1
+// timers: 0, controls: 2, polls > 0: 1
+// aggregate created by the other thread: 5
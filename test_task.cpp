@@ -0,0 +1,76 @@
+#include <unistd.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <iostream>
+#include "co.hpp"
+
+// 需要-std=c++20
+// 有栈协程负责accept，每个连接交给一个无栈协程处理
+// 无栈协程只占用一个堆上帧，而不是完整的协程栈
+
+co::Task<ssize_t> echoOnce(int connection) {
+    char buf[0xff];
+    ssize_t n = co_await co::async::read(connection, buf, sizeof buf);
+    if(n > 0) {
+        n = co_await co::async::write(connection, buf, n);
+    }
+    co_return n;
+}
+
+co::Task<> session(int connection) {
+    std::cout << "connection: " << connection << std::endl;
+    for(;;) {
+        ssize_t n = co_await echoOnce(connection);
+        if(n <= 0) break;
+    }
+    std::cout << "close: " << connection << std::endl;
+    ::close(connection);
+}
+
+void listener(int server) {
+    sockaddr addr;
+    socklen_t len = sizeof addr;
+    while(1) {
+        int connection = co::accept4(server, &addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(connection < 0) {
+            std::cerr << "what? " << strerror(errno) << std::endl;
+            continue;
+        }
+        co::detach(session(connection));
+    }
+}
+
+int main() {
+    auto &env = co::open();
+
+    ::signal(SIGPIPE, SIG_IGN);
+
+    int server = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(server < 0) {
+        ::exit(-1);
+    }
+
+    int opt = 1;
+    if(::setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &opt,
+            static_cast<socklen_t>(sizeof opt))) {
+        ::exit(-2);
+    }
+
+    sockaddr_in addr;
+    ::memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = ::htons(2333);
+    addr.sin_addr.s_addr = ::htonl(INADDR_ANY);
+
+    if(::bind(server, (const sockaddr*)&addr, sizeof addr)) {
+        ::exit(-3);
+    }
+    if(::listen(server, SOMAXCONN)) {
+        ::exit(-4);
+    }
+
+    auto co = env.createCoroutine(listener, server);
+    co->resume();
+
+    co::loop();
+}
@@ -0,0 +1,61 @@
+#include <iostream>
+#include <string>
+#include <stdexcept>
+#include "co.hpp"
+
+// TaskGroup示例：并发访问三个"后端"，总耗时接近最慢的那个而不是三者之和
+// 第二轮中一个后端失败，其余子协程通过cancelled()提前结束
+//
+// usage: ./test_taskgroup
+
+using Clock = std::chrono::steady_clock;
+
+// 用定时器模拟不同延迟的后端
+std::string fetchUser(int id) {
+    co::poll(nullptr, 0, 30);
+    return "user" + std::to_string(id);
+}
+
+int fetchScore(int id) {
+    co::poll(nullptr, 0, 50);
+    return id * 10;
+}
+
+void fetchAds(co::TaskGroup &group, bool fail) {
+    for(int i = 0; i < 10 && !group.cancelled(); ++i) {
+        co::poll(nullptr, 0, 10);
+        if(fail) throw std::runtime_error("ads unavailable");
+    }
+}
+
+int64_t since(Clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+}
+
+void handle(int id, bool fail) {
+    auto start = Clock::now();
+    co::TaskGroup group;
+    auto user = group.spawn(fetchUser, id);
+    auto score = group.spawn(fetchScore, id);
+    auto ads = group.spawn(fetchAds, std::ref(group), fail);
+    for(size_t index; (index = group.wait_any()) != co::TaskGroup::npos;) {
+        std::cout << "[" << id << "] task " << index << " done at " << since(start) << "ms" << std::endl;
+    }
+    try {
+        ads.get();
+        std::cout << "[" << id << "] " << user.get() << ", score: " << score.get() << std::endl;
+    } catch(const std::exception &e) {
+        std::cout << "[" << id << "] failed: " << e.what() << ", cancelled: " << group.cancelled() << std::endl;
+    }
+    std::cout << "[" << id << "] total " << since(start) << "ms" << std::endl;
+}
+
+int main() {
+    auto &env = co::open();
+    env.createCoroutine([] {
+        handle(1, false);
+        handle(2, true);
+        ::exit(0);
+    })->resume();
+    co::loop();
+}
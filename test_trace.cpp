@@ -0,0 +1,139 @@
+#include <unistd.h>
+#include <fcntl.h>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "co.hpp"
+
+// 事件跟踪示例：Environment::tracing()与Trace::dump()
+// 导出的Chrome trace JSON每行一个事件，这里再把它读回来，检查协程的运行和阻塞区间
+// 同样的输出写入文件后可以用chrome://tracing或者Perfetto打开
+
+struct Reader {
+    int fd;
+    void operator()() const {
+        char buf[16];
+        co::read(fd, buf, sizeof buf);
+    }
+};
+
+struct Writer {
+    int fd;
+    void operator()() const {
+        co::usleep(2000);
+        char msg[] = "jojo";
+        co::write(fd, msg, 4);
+        co::stop();
+    }
+};
+
+// 导出中的一个事件
+struct Event {
+    std::string ph;
+    std::string name;
+    int tid {-1};
+    double ts {};
+    double dur {};
+    int fd {-1};
+};
+
+// 只处理dump()的输出格式：每行一个扁平的对象
+std::string field(const std::string &line, const std::string &key) {
+    auto pos = line.find("\"" + key + "\":");
+    if(pos == std::string::npos) return {};
+    pos += key.size() + 3;
+    if(line[pos] == '"') {
+        return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+    }
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+}
+
+std::vector<Event> parse(const std::string &json) {
+    std::vector<Event> events;
+    std::istringstream is(json);
+    std::string line;
+    while(std::getline(is, line)) {
+        if(line.find("\"ph\"") == std::string::npos) continue;
+        Event event;
+        event.ph = field(line, "ph");
+        event.tid = std::stoi(field(line, "tid"));
+        event.ts = std::stod(field(line, "ts"));
+        // thread_name的名字在args中，位于最后
+        auto args = line.find("\"args\"");
+        event.name = field(line.substr(0, args), "name");
+        if(event.name == "thread_name") event.name = field(line.substr(args), "name");
+        if(event.ph == "X") event.dur = std::stod(field(line, "dur"));
+        if(args != std::string::npos && !field(line, "fd").empty()) {
+            event.fd = std::stoi(field(line, "fd"));
+        }
+        events.emplace_back(event);
+    }
+    return events;
+}
+
+int main() {
+    int fds[2];
+    if(::pipe2(fds, O_NONBLOCK)) return 1;
+    auto &env = co::open();
+    env.tracing(true);
+    env.createCoroutine(Reader{fds[0]})->resume();
+    env.createCoroutine(Writer{fds[1]})->resume();
+    co::loop();
+    env.tracing(false);
+
+    std::ostringstream os;
+    env.trace().dump(os);
+    auto json = os.str();
+    std::cout << "balanced: " << (std::count(json.begin(), json.end(), '{')
+                                  == std::count(json.begin(), json.end(), '}')) << std::endl;
+
+    auto events = parse(json);
+    auto tidOf = [&](const std::string &name) {
+        for(auto &&event : events) {
+            if(event.ph == "M" && event.name == name) return event.tid;
+        }
+        return -1;
+    };
+    int main = tidOf("main"), reader = tidOf("Reader"), writer = tidOf("Writer");
+    std::cout << "rows: main " << (main >= 0) << ", Reader " << (reader >= 0)
+              << ", Writer " << (writer >= 0) << std::endl;
+
+    // Reader阻塞在pipe上，直到Writer睡眠2ms之后写入
+    bool readerBlocked = false;
+    for(auto &&event : events) {
+        if(event.ph == "X" && event.tid == reader && event.name == "blocked") {
+            readerBlocked = event.fd == fds[0] && event.dur >= 1000;
+        }
+    }
+    std::cout << "Reader blocked on the pipe for >= 1ms: " << readerBlocked << std::endl;
+
+    // 同一线程上的运行区间互不重叠
+    std::vector<std::pair<double, double>> running;
+    for(auto &&event : events) {
+        if(event.ph == "X" && event.name == "running") {
+            running.emplace_back(event.ts, event.ts + event.dur);
+        }
+    }
+    std::sort(running.begin(), running.end());
+    bool disjoint = true;
+    for(size_t i = 1; i < running.size(); ++i) {
+        // 时间戳以微秒输出，允许舍入误差
+        disjoint = disjoint && running[i].first + 0.01 >= running[i - 1].second;
+    }
+    std::cout << "running slices disjoint: " << disjoint << std::endl;
+
+    size_t exits = std::count_if(events.begin(), events.end(),
+        [](const Event &event) { return event.ph == "i" && event.name == "exit"; });
+    std::cout << "exits: " << exits << std::endl;
+    ::close(fds[0]);
+    ::close(fds[1]);
+}
+
+// expected output:
+// balanced: 1
+// rows: main 1, Reader 1, Writer 1
+// Reader blocked on the pipe for >= 1ms: 1
+// running slices disjoint: 1
+// exits: 2
@@ -0,0 +1,55 @@
+#include <iostream>
+#include "co.hpp"
+
+// 对称式切换：生产者与消费者直接互相transfer，每次交接只有一次contextSwitch
+// 不需要先yield回到调用者，再由调用者resume另一方
+
+int main() {
+    auto &env = co::open();
+    std::shared_ptr<co::Coroutine> producer, consumer;
+    int item = 0;
+    bool done = false;
+
+    producer = env.createCoroutine([&] {
+        for(int i = 1; i <= 3; ++i) {
+            item = i;
+            std::cout << "produce " << item << std::endl;
+            co::this_coroutine::transfer(*consumer);
+        }
+        done = true;
+        co::this_coroutine::transfer(*consumer);
+    });
+
+    consumer = env.createCoroutine([&] {
+        while(!done) {
+            std::cout << "consume " << item << std::endl;
+            co::this_coroutine::transfer(*producer);
+        }
+        std::cout << "transfer to self: "
+                  << co::this_coroutine::transfer(co::Coroutine::current()) << std::endl;
+        // consumer -> outer -> inner，consumer位于inner的调用链上但不是调用者
+        auto inner = env.createCoroutine([&] {
+            std::cout << "transfer into the call chain: "
+                      << co::this_coroutine::transfer(*consumer) << std::endl;
+        });
+        env.createCoroutine([&] { inner->resume(); })->resume();
+    });
+
+    producer->resume();
+    // consumer退出后回到producer原先的调用者
+    std::cout << "back to main, consumer exit: " << consumer->exit() << std::endl;
+    producer->resume();
+    std::cout << "producer exit: " << producer->exit() << std::endl;
+}
+
+// expected output:
+// produce 1
+// consume 1
+// produce 2
+// consume 2
+// produce 3
+// consume 3
+// transfer to self: 0
+// transfer into the call chain: 0
+// back to main, consumer exit: 1
+// producer exit: 1